@@ -2,14 +2,21 @@
 
 layout(location = 0) in vec4 pos;
 
-uniform mat4 persp;
-uniform mat4 view;
+//Shared by every program, see FrameConstants in shader.hpp
+layout(std140) uniform FrameConstants {
+	mat4 persp;
+	mat4 view;
+	vec3 lightdir;
+	float time;
+	vec3 camerapos;
+};
 
 out vec3 fragpos;
 
 void main()
 {
-	vec4 p = persp * view * pos;
+	//Only rotate the skybox so that it stays centered on the camera
+	vec4 p = persp * mat4(mat3(view)) * pos;
 	gl_Position = p.xyww;
 	fragpos = pos.xyz;
 }
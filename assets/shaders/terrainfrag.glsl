@@ -6,9 +6,14 @@ in float lighting;
 in float height;
 in vec3 fragpos;
 
-uniform float time;
-uniform vec3 lightdir;
-uniform vec3 camerapos;
+//Shared by every program, see FrameConstants in shader.hpp
+layout(std140) uniform FrameConstants {
+	mat4 persp;
+	mat4 view;
+	vec3 lightdir;
+	float time;
+	vec3 camerapos;
+};
 
 uniform sampler2D terraintexture;
 
@@ -3,14 +3,22 @@
 layout(location = 0) in float y;
 layout(location = 1) in vec2 norm;
 
-uniform mat4 persp;
-uniform mat4 view;
+//Shared by every program, see FrameConstants in shader.hpp
+layout(std140) uniform FrameConstants {
+	mat4 persp;
+	mat4 view;
+	vec3 lightdir;
+	float time;
+	vec3 camerapos;
+};
+
 uniform mat4 transform;
 
-uniform vec3 lightdir;
 uniform float maxheight;
 uniform float chunksz;
 uniform int prec;
+//(x, z) offset of every chunk slot in the table, see ChunkTable::draw
+uniform samplerBuffer chunkoffsets;
 
 out float lighting;
 out float height;
@@ -18,17 +26,26 @@ out vec3 fragpos;
 
 void main()
 {
-	int ix = gl_VertexID - int(gl_VertexID / (prec + 1)) * (prec + 1);
-	int iz = int(gl_VertexID / (prec + 1));
+	//gl_VertexID includes the base vertex of the chunk's slot
+	int chunkverts = (prec + 1) * (prec + 1);
+	int slot = gl_VertexID / chunkverts;
+	int vertex = gl_VertexID - slot * chunkverts;
+	int ix = vertex - int(vertex / (prec + 1)) * (prec + 1);
+	int iz = int(vertex / (prec + 1));
+	vec2 offset = texelFetch(chunkoffsets, slot).xy;
 
 	float halfinc = chunksz / float(prec + 1);
 	float vx = -chunksz + float(ix) / float(prec + 1) * 2.0 * chunksz + halfinc;
 	float vz = -chunksz + float(iz) / float(prec + 1) * 2.0 * chunksz + halfinc;
-	vec4 pos = vec4(vx, y * maxheight, vz, 1.0);
+	vec4 pos = vec4(vx + offset.x, y * maxheight, vz + offset.y, 1.0);
 	height = pos.y / maxheight;
 	gl_Position = persp * view * transform * pos;
 	fragpos = (transform * pos).xyz;
 
-	vec3 normal = vec3(cos(norm.y) * cos(norm.x), sin(norm.y), cos(norm.y) * sin(norm.x));
+	//Octahedral decoding (see gfx::compressNormal)
+	vec3 normal = vec3(norm.x, 1.0 - abs(norm.x) - abs(norm.y), norm.y);
+	if(normal.y < 0.0)
+		normal.xz = (1.0 - abs(normal.zx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.z >= 0.0 ? 1.0 : -1.0);
+	normal = normalize(normal);
 	lighting = max(-dot(lightdir, normal), 0.0) * 0.6 + 0.4;
 }
@@ -9,7 +9,15 @@ in float lighting;
 in vec3 fragpos;
 
 uniform float viewdist;
-uniform vec3 camerapos;
+
+//Shared by every program, see FrameConstants in shader.hpp
+layout(std140) uniform FrameConstants {
+	mat4 persp;
+	mat4 view;
+	vec3 lightdir;
+	float time;
+	vec3 camerapos;
+};
 
 const float FOG_DIST = 10000.0;
 const float WATER_FOG_DIST = 128.0;
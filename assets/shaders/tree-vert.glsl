@@ -10,15 +10,19 @@ layout(location = 1) in vec2 texcoord;
 layout(location = 2) in vec3 norm;
 layout(location = 3) in vec3 offset;
 
-uniform float time;
+//Shared by every program, see FrameConstants in shader.hpp
+layout(std140) uniform FrameConstants {
+	mat4 persp;
+	mat4 view;
+	vec3 lightdir;
+	float time;
+	vec3 camerapos;
+};
 
-uniform mat4 persp;
-uniform mat4 view;
 uniform mat4 transform;
 
 uniform float windstrength;
 
-uniform vec3 lightdir;
 out float lighting;
 
 out vec3 fragpos;
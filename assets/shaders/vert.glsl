@@ -3,11 +3,17 @@
 layout(location = 0) in vec4 pos;
 layout(location = 1) in vec3 norm;
 
-uniform mat4 persp;
-uniform mat4 view;
+//Shared by every program, see FrameConstants in shader.hpp
+layout(std140) uniform FrameConstants {
+	mat4 persp;
+	mat4 view;
+	vec3 lightdir;
+	float time;
+	vec3 camerapos;
+};
+
 uniform mat4 transform;
 
-uniform vec3 lightdir;
 out float lighting;
 
 out vec3 fragpos;
@@ -11,9 +11,14 @@ in vec3 fragpos;
 //data into memory so to play nice with the cache I've combined the textures
 uniform sampler2D watermaps;
 
-uniform float time;
-uniform vec3 lightdir;
-uniform vec3 camerapos;
+//Shared by every program, see FrameConstants in shader.hpp
+layout(std140) uniform FrameConstants {
+	mat4 persp;
+	mat4 view;
+	vec3 lightdir;
+	float time;
+	vec3 camerapos;
+};
 
 uniform float viewdist;
 
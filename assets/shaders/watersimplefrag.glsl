@@ -4,8 +4,14 @@ out vec4 color;
 
 in vec3 fragpos;
 
-uniform vec3 lightdir;
-uniform vec3 camerapos;
+//Shared by every program, see FrameConstants in shader.hpp
+layout(std140) uniform FrameConstants {
+	mat4 persp;
+	mat4 view;
+	vec3 lightdir;
+	float time;
+	vec3 camerapos;
+};
 
 uniform float viewdist;
 
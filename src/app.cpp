@@ -1,4 +1,8 @@
 #include "app.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "memledger.hpp"
+#include "glstats.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 #include <map>
@@ -81,6 +85,13 @@ void handleKeyInput(GLFWwindow *window, int key, int scancode, int action, int m
 		);
 	}
 
+	//Toggle trace recording
+	if(key == GLFW_KEY_F2 && action == GLFW_RELEASE)
+		prof::toggleTrace();
+	//Print how much memory is being used
+	if(key == GLFW_KEY_F3 && action == GLFW_RELEASE)
+		mem::report();
+
 	Camera& cam = State::get()->getCamera();
 	if(action == GLFW_PRESS && keyToMovement.count(key))
 		cam.updateMovement(keyToMovement.at(key), true);
@@ -95,14 +106,29 @@ void initMousePos(GLFWwindow *window)
 	State::get()->setMousePos(mousex, mousey);
 }
 
-bool outputFps(float dt, unsigned int &chunksPerSecond)
+bool outputFps(float dt, unsigned int &chunksPerSecond, unsigned int backlog)
 {
 	static float fpstimer = 0.0f;
 	static int frames = 0;
 	fpstimer += dt;
+	prof::collect();
 
 	if(fpstimer > 1.0f) {
-		fprintf(stderr, "FPS: %d | Chunks drawn: %d\n", frames, chunksPerSecond);
+		char header[128];
+		snprintf(
+			header,
+			sizeof(header),
+			"FPS: %d | Chunks drawn: %d | World update backlog: %d",
+			frames,
+			chunksPerSecond,
+			backlog
+		);
+		prof::printSummary(header, frames);
+		prof::reset();
+		if(glstats::installed()) {
+			glstats::printSummary(frames);
+			glstats::reset();
+		}
 		fpstimer = 0;
 		frames = 0;
 		chunksPerSecond = 0;
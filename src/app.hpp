@@ -19,4 +19,5 @@ void handleWindowResize(GLFWwindow *window, int w, int h);
 void cursorPosCallback(GLFWwindow *window, double x, double y);
 void handleKeyInput(GLFWwindow *window, int key, int scancode, int action, int mods);
 void initMousePos(GLFWwindow *window);
-bool outputFps(float dt, unsigned int &chunksPerSecond);
+//Prints the fps and the time spent in every profiled phase once a second
+bool outputFps(float dt, unsigned int &chunksPerSecond, unsigned int backlog);
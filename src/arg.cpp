@@ -8,6 +8,15 @@
 constexpr unsigned int RANGE = 8;
 constexpr unsigned int MIN_RANGE = 6;
 constexpr unsigned int MAX_RANGE = 48;
+//Default world update budget (milliseconds)
+constexpr float BUDGET = 4.0f;
+//Default benchmark output file
+constexpr const char *BENCHMARK_OUT = "benchmark.csv";
+//Default trace output file
+constexpr const char *TRACE_OUT = "trace.json";
+//Default threshold for dumping the frames around a slow frame, the flight
+//recorder is off unless it is asked for
+constexpr float HITCH_MS = 0.0f;
 
 bool streq(const char *s1, const char *s2)
 {
@@ -22,6 +31,28 @@ ArgType getArgType(const char *arg)
 		return SEED_ARG;
 	if(streq(arg, "-r") || streq(arg, "--range"))
 		return RANGE_ARG;
+	if(streq(arg, "-b") || streq(arg, "--budget"))
+		return BUDGET_ARG;
+	if(streq(arg, "--headless"))
+		return HEADLESS;
+	if(streq(arg, "--center"))
+		return CENTER_ARG;
+	if(streq(arg, "--benchmark"))
+		return BENCHMARK_ARG;
+	if(streq(arg, "--benchmark-out"))
+		return BENCHMARK_OUT_ARG;
+	if(streq(arg, "--fixed-dt"))
+		return FIXED_DT_ARG;
+	if(streq(arg, "--record"))
+		return RECORD_ARG;
+	if(streq(arg, "--trace"))
+		return TRACE_ARG;
+	if(streq(arg, "--hitch-ms"))
+		return HITCH_ARG;
+	if(streq(arg, "--gl-stats"))
+		return GL_STATS;
+	if(streq(arg, "--no-occlusion"))
+		return NO_OCCLUSION;
 	if(streq(arg, "-h") || streq(arg, "--help"))
 		return HELP;
 	if(streq(arg, "--license"))
@@ -31,13 +62,48 @@ ArgType getArgType(const char *arg)
 
 void usage(char *argv[])
 {
-	fprintf(stderr, "usage: %s -s|--seed -r|--range\n", argv[0]);
+	fprintf(
+		stderr,
+		"usage: %s -s|--seed -r|--range -b|--budget --headless --center "
+		"--benchmark --benchmark-out --fixed-dt --record --trace --hitch-ms --gl-stats --no-occlusion\n",
+		argv[0]
+	);
 	fprintf(stderr, "-s|--seed [number]\n");
 	fprintf(stderr, "\tset a seed for the world, default: random\n");
 	fprintf(stderr, "-r|--range [number]\n");
 	fprintf(stderr, "\tset a viewing range, default: %d chunks\n", RANGE);
 	fprintf(stderr, "\tvalue should be between %d and %d\n", MIN_RANGE, MAX_RANGE);
 	fprintf(stderr, "\tNOTE: setting range to a high value will result in lower performance\n");	
+	fprintf(stderr, "-b|--budget [milliseconds]\n");
+	fprintf(stderr, "\tset the time spent each frame on updating the world, default: %g ms\n", BUDGET);
+	fprintf(stderr, "\twork that does not fit is carried over to the next frame\n");
+	fprintf(stderr, "--headless\n");
+	fprintf(stderr, "\tgenerate the world within range of the origin (or --center) without\n");
+	fprintf(stderr, "\topening a window, prints how long it took and a hash of the generated world\n");
+	fprintf(stderr, "--center [x,z]\n");
+	fprintf(stderr, "\tpoint in the world that --headless generates around, default: 0,0\n");
+	fprintf(stderr, "--benchmark [path file]\n");
+	fprintf(stderr, "\tmove the camera along the path in the file and exit once it ends,\n");
+	fprintf(stderr, "\tframe statistics are written to the --benchmark-out file\n");
+	fprintf(stderr, "--benchmark-out [file]\n");
+	fprintf(stderr, "\tfile to write benchmark results to (JSON if it ends in .json,\n");
+	fprintf(stderr, "\tCSV otherwise), default: %s\n", BENCHMARK_OUT);
+	fprintf(stderr, "--fixed-dt [seconds]\n");
+	fprintf(stderr, "\tadvance time by a fixed amount every frame, default: off\n");
+	fprintf(stderr, "--record [path file]\n");
+	fprintf(stderr, "\trecord the camera's movement to a path file for --benchmark\n");
+	fprintf(stderr, "--trace [file]\n");
+	fprintf(stderr, "\tstart recording a trace (Chrome trace JSON) right away and write it\n");
+	fprintf(stderr, "\tto the file on exit, F2 starts and stops tracing at any time\n");
+	fprintf(stderr, "\t(default file: %s, used when no file follows --trace)\n", TRACE_OUT);
+	fprintf(stderr, "--hitch-ms [milliseconds]\n");
+	fprintf(stderr, "\twhen a frame takes longer than this, write a trace of the frames\n");
+	fprintf(stderr, "\taround it to hitch-<frame>.json, 0 disables it (default: off)\n");
+	fprintf(stderr, "--gl-stats\n");
+	fprintf(stderr, "\tcount draw calls, state changes, uniform updates and bytes uploaded\n");
+	fprintf(stderr, "\tper render pass and print them along with the fps\n");
+	fprintf(stderr, "--no-occlusion\n");
+	fprintf(stderr, "\tdraw terrain chunks that are hidden behind nearer terrain\n");
 	fprintf(stderr, "-h|--help\n");
 	fprintf(stderr, "\tshow this screen\n");
 	fprintf(stderr, "--license\n");
@@ -68,14 +134,43 @@ void license()
 	fprintf(stderr, "%s\n", COPYRIGHT);
 }
 
-void setArgVal(Args &argvals, ArgType argtype, int v)
+void setArgVal(Args &argvals, ArgType argtype, const char *v)
 {
 	switch(argtype) {
 	case SEED_ARG:
-		argvals.seed = v;
+		argvals.seed = atoi(v);
 		break;
 	case RANGE_ARG:
-		argvals.range = v;
+		argvals.range = atoi(v);
+		break;
+	case BUDGET_ARG:
+		argvals.budget = atof(v);
+		break;
+	case BENCHMARK_ARG:
+		argvals.benchmark = v;
+		break;
+	case BENCHMARK_OUT_ARG:
+		argvals.benchmarkout = v;
+		break;
+	case FIXED_DT_ARG:
+		argvals.fixeddt = atof(v);
+		break;
+	case RECORD_ARG:
+		argvals.record = v;
+		break;
+	case CENTER_ARG:
+		if(sscanf(v, "%f,%f", &argvals.centerx, &argvals.centerz) != 2) {
+			fprintf(stderr, "--center expects two numbers separated by a comma\n");
+			exit(1);
+		}
+		break;
+	case TRACE_ARG:
+		argvals.trace = v;
+		argvals.tracestart = true;
+		break;
+	case HITCH_ARG:
+		argvals.hitchms = atof(v);
+		break;
 	default:
 		break;
 	}
@@ -88,7 +183,20 @@ Args parseArgs(int argc, char *argv[])
 
 	Args argvals = {
 		.seed = randSeed,
-		.range = RANGE
+		.range = RANGE,
+		.budget = BUDGET,
+		.headless = false,
+		.centerx = 0.0f,
+		.centerz = 0.0f,
+		.benchmark = nullptr,
+		.benchmarkout = BENCHMARK_OUT,
+		.fixeddt = 0.0f,
+		.record = nullptr,
+		.trace = TRACE_OUT,
+		.tracestart = false,
+		.hitchms = HITCH_MS,
+		.glstats = false,
+		.occlusion = true
 	};
 	ArgType arg = NO_ARG;
 
@@ -96,8 +204,7 @@ Args parseArgs(int argc, char *argv[])
 		if(arg == NO_ARG)
 			arg = getArgType(argv[i]);
 		else {
-			int val = atoi(argv[i]);
-			setArgVal(argvals, arg, val);
+			setArgVal(argvals, arg, argv[i]);
 			arg = NO_ARG;
 		}
 
@@ -112,6 +219,26 @@ Args parseArgs(int argc, char *argv[])
 		case LICENSE:
 			license();
 			exit(0);
+		case HEADLESS:
+			argvals.headless = true;
+			arg = NO_ARG;
+			break;
+		case GL_STATS:
+			argvals.glstats = true;
+			arg = NO_ARG;
+			break;
+		case NO_OCCLUSION:
+			argvals.occlusion = false;
+			arg = NO_ARG;
+			break;
+		case TRACE_ARG:
+			//The file is optional, trace to the default one if the next
+			//argument is another option (or there is none)
+			if(i + 1 >= argc || argv[i + 1][0] == '-') {
+				argvals.tracestart = true;
+				arg = NO_ARG;
+			}
+			break;
 		default:
 			break;
 		}
@@ -119,6 +246,7 @@ Args parseArgs(int argc, char *argv[])
 
 	argvals.range = std::max(MIN_RANGE, argvals.range);
 	argvals.range = std::min(MAX_RANGE, argvals.range);
+	argvals.budget = std::max(0.0f, argvals.budget);
 
 	return argvals;
 }
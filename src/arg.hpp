@@ -3,11 +3,49 @@
 struct Args {
 	int seed;
 	unsigned int range;
+	//Milliseconds per frame that can be spent on updating the world
+	float budget;
+	//Generate the world without opening a window (see headless.hpp)
+	bool headless;
+	//Point (in world space) that --headless generates the world around
+	float centerx, centerz;
+	//Path file for the camera to follow (see benchmark.hpp), null if
+	//the camera is controlled by the user
+	const char *benchmark;
+	//Where to write the benchmark results
+	const char *benchmarkout;
+	//If greater than 0, every frame advances time by this many seconds
+	//instead of by how long the frame took
+	float fixeddt;
+	//Path file to record the camera's movement to, null if not recording
+	const char *record;
+	//File to write traces to (see trace.hpp)
+	const char *trace;
+	//Start tracing as soon as the program starts
+	bool tracestart;
+	//Frames that take longer than this many milliseconds have the frames
+	//around them written to disk (see flightrecorder.hpp), 0 to disable
+	float hitchms;
+	//Count GL calls and bytes uploaded (see glstats.hpp)
+	bool glstats;
+	//Skip drawing terrain hidden behind nearer terrain (see horizon.hpp)
+	bool occlusion;
 };
 
 enum ArgType {
 	SEED_ARG,
 	RANGE_ARG,
+	BUDGET_ARG,
+	HEADLESS,
+	CENTER_ARG,
+	BENCHMARK_ARG,
+	BENCHMARK_OUT_ARG,
+	FIXED_DT_ARG,
+	RECORD_ARG,
+	TRACE_ARG,
+	HITCH_ARG,
+	GL_STATS,
+	NO_OCCLUSION,
 	HELP,
 	LICENSE,
 	ERR,
@@ -0,0 +1,219 @@
+#include "benchmark.hpp"
+#include <string.h>
+#include <algorithm>
+
+namespace bench {
+	bool CameraPath::load(const char *path)
+	{
+		FILE *file = fopen(path, "r");
+		if(!file)
+			return false;
+
+		keys.clear();
+		char line[256];
+		while(fgets(line, sizeof(line), file)) {
+			if(line[0] == '#')
+				continue;
+			CameraKey key;
+			int read = sscanf(
+				line,
+				" key %f %f %f %f %f %f",
+				&key.time,
+				&key.position.x,
+				&key.position.y,
+				&key.position.z,
+				&key.yaw,
+				&key.pitch
+			);
+			if(read == 6)
+				keys.push_back(key);
+		}
+
+		fclose(file);
+		return !keys.empty();
+	}
+
+	float CameraPath::duration() const
+	{
+		if(keys.empty())
+			return 0.0f;
+		return keys.back().time;
+	}
+
+	//Catmull-Rom interpolation between b and c
+	template<typename T>
+	T catmullRom(const T &a, const T &b, const T &c, const T &d, float t)
+	{
+		float t2 = t * t, t3 = t2 * t;
+		return
+			b * 2.0f * 0.5f +
+			(c - a) * t * 0.5f +
+			(a * 2.0f - b * 5.0f + c * 4.0f - d) * t2 * 0.5f +
+			(b * 3.0f - a - c * 3.0f + d) * t3 * 0.5f;
+	}
+
+	void CameraPath::apply(Camera &cam, float t) const
+	{
+		if(keys.empty())
+			return;
+
+		//Find the segment that t is in
+		unsigned int i = 0;
+		while(i + 1 < keys.size() - 1 && keys.at(i + 1).time <= t)
+			i++;
+		const CameraKey
+			&b = keys.at(i),
+			&c = keys.at(std::min<size_t>(i + 1, keys.size() - 1)),
+			&a = keys.at(i > 0 ? i - 1 : i),
+			&d = keys.at(std::min<size_t>(i + 2, keys.size() - 1));
+
+		float length = c.time - b.time;
+		float s = length > 0.0f ? (t - b.time) / length : 0.0f;
+		s = std::min(std::max(s, 0.0f), 1.0f);
+
+		cam.position = catmullRom(a.position, b.position, c.position, d.position, s);
+		cam.yaw = catmullRom(a.yaw, b.yaw, c.yaw, d.yaw, s);
+		cam.pitch = catmullRom(a.pitch, b.pitch, c.pitch, d.pitch, s);
+	}
+
+	PathRecorder::PathRecorder(const char *path, float keyinterval)
+	{
+		interval = keyinterval;
+		if(path)
+			file = fopen(path, "w");
+		if(file)
+			fprintf(file, "# key <time> <x> <y> <z> <yaw> <pitch>\n");
+	}
+
+	PathRecorder::~PathRecorder()
+	{
+		if(file)
+			fclose(file);
+	}
+
+	bool PathRecorder::isOpen() const
+	{
+		return file != nullptr;
+	}
+
+	void PathRecorder::record(const Camera &cam, float time)
+	{
+		if(!file || (time - lastkey < interval && time > 0.0f))
+			return;
+		fprintf(
+			file,
+			"key %f %f %f %f %f %f\n",
+			time,
+			cam.position.x,
+			cam.position.y,
+			cam.position.z,
+			cam.yaw,
+			cam.pitch
+		);
+		lastkey = time;
+	}
+
+	void FrameLog::add(const FrameSample &sample)
+	{
+		frames.push_back(sample);
+	}
+
+	struct Percentiles {
+		const char *name;
+		float p50, p95, p99, max;
+	};
+
+	//Nearest rank percentiles
+	Percentiles getPercentiles(const char *name, std::vector<float> values)
+	{
+		if(values.empty())
+			return { name, 0.0f, 0.0f, 0.0f, 0.0f };
+		std::sort(values.begin(), values.end());
+		auto percentile = [&values](float p) {
+			size_t rank = size_t(p / 100.0f * float(values.size()) + 0.5f);
+			rank = std::min(std::max<size_t>(rank, 1), values.size());
+			return values.at(rank - 1);
+		};
+		return { name, percentile(50.0f), percentile(95.0f), percentile(99.0f), values.back() };
+	}
+
+	std::vector<Percentiles> summarize(const std::vector<FrameSample> &frames)
+	{
+		std::vector<float> cputime, generated, drawn, instances;
+		for(const auto &frame : frames) {
+			cputime.push_back(frame.cputime);
+			generated.push_back(float(frame.chunksgenerated));
+			drawn.push_back(float(frame.chunksdrawn));
+			instances.push_back(float(frame.instancesdrawn));
+		}
+
+		return {
+			getPercentiles("cpu_ms", cputime),
+			getPercentiles("chunks_generated", generated),
+			getPercentiles("chunks_drawn", drawn),
+			getPercentiles("instances_drawn", instances),
+		};
+	}
+
+	bool FrameLog::write(const char *path) const
+	{
+		FILE *file = fopen(path, "w");
+		if(!file)
+			return false;
+
+		std::vector<Percentiles> summary = summarize(frames);
+		size_t len = strlen(path);
+		bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+		if(json) {
+			fprintf(file, "{\n\t\"frames\": %zu,\n", frames.size());
+			for(size_t i = 0; i < summary.size(); i++) {
+				const Percentiles &p = summary.at(i);
+				fprintf(
+					file,
+					"\t\"%s\": { \"p50\": %f, \"p95\": %f, \"p99\": %f, \"max\": %f }%s\n",
+					p.name,
+					p.p50,
+					p.p95,
+					p.p99,
+					p.max,
+					i + 1 < summary.size() ? "," : ""
+				);
+			}
+			fprintf(file, "}\n");
+		}
+		else {
+			fprintf(file, "metric,frames,p50,p95,p99,max\n");
+			for(const auto &p : summary) {
+				fprintf(
+					file,
+					"%s,%zu,%f,%f,%f,%f\n",
+					p.name,
+					frames.size(),
+					p.p50,
+					p.p95,
+					p.p99,
+					p.max
+				);
+			}
+		}
+
+		fclose(file);
+		return true;
+	}
+
+	void FrameLog::print() const
+	{
+		fprintf(stderr, "Frames: %zu\n", frames.size());
+		for(const auto &p : summarize(frames)) {
+			fprintf(
+				stderr,
+				"%s: p50 %f | p95 %f | p99 %f | max %f\n",
+				p.name,
+				p.p50,
+				p.p95,
+				p.p99,
+				p.max
+			);
+		}
+	}
+}
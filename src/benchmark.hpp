@@ -0,0 +1,70 @@
+/*
+ * Scripted camera paths and frame time logging so that different builds
+ * can be compared on exactly the same workload.
+ *
+ * A path file is a list of keyframes, one per line:
+ *
+ * key <time> <x> <y> <z> <yaw> <pitch>
+ *
+ * Lines starting with '#' are ignored and the keyframes must be sorted by
+ * time. The camera follows a Catmull-Rom spline through the keyframes.
+ * Paths can be written by hand, generated, or recorded with --record.
+ * */
+
+#pragma once
+#include <vector>
+#include <stdio.h>
+#include <glm/glm.hpp>
+#include "camera.hpp"
+
+namespace bench {
+	struct CameraKey {
+		float time;
+		glm::vec3 position;
+		float yaw, pitch;
+	};
+
+	class CameraPath {
+		std::vector<CameraKey> keys;
+	public:
+		//Returns false if the file could not be read or has no keyframes
+		bool load(const char *path);
+		//Time of the last keyframe
+		float duration() const;
+		//Moves the camera to where it should be at time t
+		void apply(Camera &cam, float t) const;
+	};
+
+	//Writes the camera's position as keyframes to a path file
+	class PathRecorder {
+		FILE *file = nullptr;
+		float lastkey = 0.0f;
+		//Seconds between keyframes
+		float interval;
+	public:
+		PathRecorder(const char *path, float keyinterval);
+		~PathRecorder();
+		bool isOpen() const;
+		void record(const Camera &cam, float time);
+	};
+
+	struct FrameSample {
+		//Milliseconds of cpu time spent on the frame
+		float cputime;
+		unsigned int chunksgenerated;
+		unsigned int chunksdrawn;
+		unsigned int instancesdrawn;
+	};
+
+	class FrameLog {
+		std::vector<FrameSample> frames;
+	public:
+		void add(const FrameSample &sample);
+		//Writes p50, p95, p99 and max of every value to 'path', the
+		//output is JSON if the path ends in ".json" and CSV otherwise.
+		//Returns false if the file could not be written
+		bool write(const char *path) const;
+		//Prints the same summary to stderr
+		void print() const;
+	};
+}
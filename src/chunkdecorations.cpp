@@ -1,7 +1,10 @@
 #include "infworld.hpp"
+#include "profiler.hpp"
+#include "memledger.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <algorithm>
+#include "jobs.hpp"
 
 namespace infworld {
 	int getChunkSeed(int x, int z, const worldseed &permutations)
@@ -22,13 +25,26 @@ namespace infworld {
 	}
 
 	DecorationTable::DecorationTable(unsigned int sz, float scale)
-	{
+		: DecorationTable(sz, scale, 0.0f, 0.0f)
+	{}
+
+	DecorationTable::DecorationTable(
+		unsigned int sz,
+		float scale,
+		float camerax,
+		float cameraz
+	) {
 		size = 2 * sz + 1;
 		chunkscale = scale;
-		for(int x = -int(sz); x <= int(sz); x++)
-			for(int z = -int(sz); z <= int(sz); z++)
+		ChunkPos center = chunkAt(camerax, cameraz);
+		centerx = center.x;
+		centerz = center.z;
+		for(int x = centerx - int(sz); x <= centerx + int(sz); x++)
+			for(int z = centerz - int(sz); z <= centerz + int(sz); z++)
 				positions.push_back({ x, z });	
 		decorations = std::vector<std::vector<Decoration>>(count());
+		staged = std::make_shared<StagedDecorations>();
+		generating = std::make_shared<jobs::Counter>();
 	}
 
 	unsigned int DecorationTable::count()
@@ -36,11 +52,33 @@ namespace infworld {
 		return size * size;
 	}
 
+	size_t DecorationTable::bytes() const
+	{
+		size_t total = 0;
+		for(const auto &chunk : decorations)
+			total += chunk.capacity() * sizeof(Decoration);
+		std::lock_guard<std::mutex> guard(staged->lock);
+		for(const auto &chunk : staged->chunks)
+			total += chunk.second.capacity() * sizeof(Decoration);
+		return total;
+	}
+
+	ChunkPos DecorationTable::getPos(unsigned int index) const
+	{
+		return positions.at(index);
+	}
+
+	const std::vector<Decoration>& DecorationTable::getDecorations(unsigned int index) const
+	{
+		return decorations.at(index);
+	}
+
 	//Draw chunk decorations
-	void DecorationTable::drawDecorations(const gfx::Vao &vao) {
+	unsigned int DecorationTable::drawDecorations(const gfx::Vao &vao) {
 		if(!vaoCount.count(vao.vaoid))
-			return;
+			return 0;
 		glDrawElementsInstanced(GL_TRIANGLES, vao.vertcount, GL_UNSIGNED_INT, 0, vaoCount.at(vao.vaoid));
+		return vaoCount.at(vao.vaoid);
 	}
 
 	void DecorationTable::genDecorations(
@@ -49,7 +87,8 @@ namespace infworld {
 		unsigned int n,
 		int x,
 		int z,
-		unsigned int index,
+		float chunkscale,
+		std::vector<Decoration> &decorations,
 		std::minstd_rand0 &lcg
 	) {
 		float chunksz = chunkscale * 2.0f * float(PREC) / float(PREC + 1);	
@@ -68,56 +107,83 @@ namespace infworld {
 			y *= HEIGHT;
 			x *= float(PREC) / float(PREC + 1);
 			z *= float(PREC) / float(PREC + 1);
-			decorations.at(index).push_back({
+			decorations.push_back({
 				glm::vec3(x, y - 0.5f, z),
 				type,
 			});
 		}
 	}
 
-	void DecorationTable::generate(const worldseed &permutations, unsigned int index)
-	{
-		ChunkPos pos = positions.at(index);
+	std::vector<Decoration> DecorationTable::generate(
+		const worldseed &permutations,
+		ChunkPos pos,
+		float chunkscale
+	) {
+		PROFILE_SCOPE_XZ("DecorationTable::generate", pos.x, pos.z);
+		std::vector<Decoration> decorations;
 		int seed = getChunkSeed(pos.x, pos.z, permutations);
 		std::minstd_rand0 lcg;
 		lcg.seed(seed);
-		genDecorations(permutations, PINE_TREE, 72, pos.x, pos.z, index, lcg);
-		genDecorations(permutations, TREE, 24, pos.x, pos.z, index, lcg);
+		genDecorations(permutations, PINE_TREE, 72, pos.x, pos.z, chunkscale, decorations, lcg);
+		genDecorations(permutations, TREE, 24, pos.x, pos.z, chunkscale, decorations, lcg);
 
-		decorations.at(index).erase(std::remove_if(
-			decorations.at(index).begin(),
-			decorations.at(index).end(),
+		decorations.erase(std::remove_if(
+			decorations.begin(),
+			decorations.end(),
 			[&permutations](Decoration d) {
 				float x = d.position.x / 128.0f;
 				float z = d.position.z / 128.0f;
 				return perlin::noise(x, z, permutations.at(0)) < 0.0f;
 			}
-		), decorations.at(index).end());
+		), decorations.end());
 
-		decorations.at(index).erase(std::remove_if(
-			decorations.at(index).begin(),
-			decorations.at(index).end(),
+		decorations.erase(std::remove_if(
+			decorations.begin(),
+			decorations.end(),
 			[](Decoration d) {
 				float y = d.position.y / HEIGHT;
 				return d.type == TREE && (y < 0.02f || y > 0.2f);
 			}
-		), decorations.at(index).end());
+		), decorations.end());
 
-		decorations.at(index).erase(std::remove_if(
-			decorations.at(index).begin(),
-			decorations.at(index).end(),
+		decorations.erase(std::remove_if(
+			decorations.begin(),
+			decorations.end(),
 			[](Decoration d) {
 				float y = d.position.y / HEIGHT;
 				return d.type == PINE_TREE && (y < 0.04f || y > 0.3f);
 			}
-		), decorations.at(index).end());
+		), decorations.end());
+
+		return decorations;
+	}
+
+	ChunkPos DecorationTable::chunkAt(float x, float z) const
+	{
+		float chunksz = 
+			chunkscale * 
+			float(PREC) / float(PREC + 1) *
+			float(PREC) / float(PREC + 1);
+		return {
+			int(floorf((z + chunksz * SCALE) / (chunksz * SCALE * 2.0f))),
+			int(floorf((x + chunksz * SCALE) / (chunksz * SCALE * 2.0f)))
+		};
 	}
 
 	//Generate decorations
 	void DecorationTable::genDecorations(const worldseed &permutations)
 	{
-		for(int i = 0; i < decorations.size(); i++)
-			generate(permutations, i);
+		jobs::WorkerPool *pool = jobs::WorkerPool::get();
+		jobs::Counter generated;
+		for(int i = 0; i < decorations.size(); i++) {
+			pool->submit(
+				[this, &permutations, i]() {
+					decorations.at(i) = generate(permutations, positions.at(i), chunkscale);
+				},
+				generated
+			);
+		}
+		pool->wait(generated);
 	}
 
 	bool DecorationTable::genNewDecorations(
@@ -125,13 +191,12 @@ namespace infworld {
 		float cameraz,
 		const worldseed &permutations
 	) {
-		float chunksz = 
-			chunkscale * 
-			float(PREC) / float(PREC + 1) *
-			float(PREC) / float(PREC + 1);
-		int
-			ix = int(floorf((cameraz + chunksz * SCALE) / (chunksz * SCALE * 2.0f))),
-			iz = int(floorf((camerax + chunksz * SCALE) / (chunksz * SCALE * 2.0f)));
+		PROFILE_SCOPE("DecorationTable::genNewDecorations");
+		if(!finishedGenerating())
+			return false;
+
+		ChunkPos center = chunkAt(camerax, cameraz);
+		int ix = center.x, iz = center.z;
 		if(ix == centerx && iz == centerz)
 			return false;
 
@@ -153,12 +218,32 @@ namespace infworld {
 			indices.push_back(i);
 		}
 
+		jobs::WorkerPool *pool = jobs::WorkerPool::get();
 		for(int i = 0; i < indices.size(); i++) {
 			unsigned int index = indices.at(i);
 			ChunkPos pos = newChunks.at(i);
 			positions.at(index) = pos;
 			decorations.at(index).clear();
-			generate(permutations, index);
+
+			//Use the prefetched decorations if they are ready, chunks that
+			//are still being prefetched are generated again instead of
+			//waiting on them
+			{
+				std::lock_guard<std::mutex> guard(staged->lock);
+				auto stagedchunk = staged->chunks.find(chunkKey(pos));
+				if(stagedchunk != staged->chunks.end()) {
+					decorations.at(index) = std::move(stagedchunk->second);
+					staged->chunks.erase(stagedchunk);
+					continue;
+				}
+			}
+
+			pool->submit(
+				[this, &permutations, index, pos]() {
+					decorations.at(index) = generate(permutations, pos, chunkscale);
+				},
+				*generating
+			);
 		}
 
 		centerx = ix;
@@ -167,12 +252,77 @@ namespace infworld {
 		return true;
 	}
 
+	void DecorationTable::prefetch(
+		float predictedx,
+		float predictedz,
+		const worldseed &permutations
+	) {
+		//Only look one chunk ahead so the staging area stays small
+		ChunkPos predicted = chunkAt(predictedx, predictedz);
+		int
+			ix = std::min(std::max(predicted.x, centerx - 1), centerx + 1),
+			iz = std::min(std::max(predicted.z, centerz - 1), centerz + 1);
+		int range = (size - 1) / 2;
+
+		std::shared_ptr<StagedDecorations> stage = staged;
+		std::lock_guard<std::mutex> guard(stage->lock);
+
+		//Throw away decorations that are no longer expected to be needed
+		for(auto it = stage->chunks.begin(); it != stage->chunks.end(); ) {
+			int x = int32_t(it->first >> 32), z = int32_t(it->first & 0xffffffff);
+			bool predicted = labs(x - ix) <= range && labs(z - iz) <= range;
+			bool current = labs(x - centerx) <= range && labs(z - centerz) <= range;
+			if(!predicted && !current)
+				it = stage->chunks.erase(it);
+			else
+				it++;
+		}
+
+		if(ix == centerx && iz == centerz)
+			return;
+
+		jobs::WorkerPool *pool = jobs::WorkerPool::get();
+		float scale = chunkscale;
+		for(int x = ix - range; x <= ix + range; x++) {
+			for(int z = iz - range; z <= iz + range; z++) {
+				if(labs(x - centerx) <= range && labs(z - centerz) <= range)
+					continue;
+				ChunkPos pos = { x, z };
+				uint64_t key = chunkKey(pos);
+				if(stage->chunks.count(key) || stage->prefetching.count(key))
+					continue;
+				stage->prefetching.insert(key);
+				pool->submit(
+					[stage, &permutations, pos, key, scale]() {
+						std::vector<Decoration> decorations = generate(permutations, pos, scale);
+						std::lock_guard<std::mutex> guard(stage->lock);
+						stage->prefetching.erase(key);
+						stage->chunks[key] = std::move(decorations);
+					},
+					stage->pending
+				);
+			}
+		}
+	}
+
+	bool DecorationTable::finishedGenerating() const
+	{
+		return generating->finished();
+	}
+
+	void DecorationTable::waitForPending()
+	{
+		jobs::WorkerPool::get()->wait(*generating);
+		jobs::WorkerPool::get()->wait(staged->pending);
+	}
+
 	void DecorationTable::generateOffsets(
 		DecorationType type,
 		const gfx::Vao &vao,
 		unsigned int minrange,
 		unsigned int maxrange
 	) {
+		PROFILE_SCOPE("DecorationTable::generateOffsets");
 		if(decorations.size() == 0)
 			return;
 
@@ -203,6 +353,7 @@ namespace infworld {
 
 		glBindBuffer(GL_ARRAY_BUFFER, vao.buffers.at(4));
 		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * offsets.size(), &offsets[0], GL_STATIC_DRAW);
+		mem::trackBuffer("decoration instances", vao.buffers.at(4), sizeof(float) * offsets.size());
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 }
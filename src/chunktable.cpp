@@ -1,14 +1,53 @@
 #include "infworld.hpp"
+#include "profiler.hpp"
+#include "memledger.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
 
 namespace infworld {
+	//Index buffer shared by the chunks of every ChunkTable, created by the
+	//first table to generate its buffers and deleted along with the last
+	unsigned int chunkindexbuffer = 0;
+	unsigned int chunkindexusers = 0;
+
+	void createChunkIndexBuffer()
+	{
+		std::vector<uint16_t> indices = createChunkIndices();
+		glGenBuffers(1, &chunkindexbuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunkindexbuffer);
+		if(GLAD_GL_VERSION_4_4) {
+			glBufferStorage(
+				GL_ELEMENT_ARRAY_BUFFER,
+				indices.size() * sizeof(uint16_t),
+				&indices[0],
+				0
+			);
+		}
+		else {
+			glBufferData(
+				GL_ELEMENT_ARRAY_BUFFER,
+				indices.size() * sizeof(uint16_t),
+				&indices[0],
+				GL_STATIC_DRAW
+			);
+		}
+		mem::trackBuffer("terrain indices", chunkindexbuffer, indices.size() * sizeof(uint16_t));
+	}
+
 	//Default constructor
 	ChunkTable::ChunkTable()
 	{
 		size = 0;
 		chunkcount = 0;
 		chunkscale = 0.0f;
+		octaves = 0;
+		builtchunks = std::make_shared<BuiltChunkQueue>();
 	}
 
 	ChunkTable::ChunkTable(unsigned int range, float scale, float h)
@@ -17,88 +56,152 @@ namespace infworld {
 		chunkcount = size * size;
 		chunkscale = scale;
 		height = h;
-		vaoids = std::vector<unsigned int>(chunkcount);
+		//Distance between vertices in a chunk
+		octaves = octavesForSpacing(scale * 2.0f / float(PREC));
 		chunkpos = std::vector<infworld::ChunkPos>(chunkcount);
-		bufferids = std::vector<unsigned int>(BUFFER_PER_CHUNK * chunkcount);
+		bounds.resize(chunkcount);
+		slotheights = std::vector<ChunkHeights>(chunkcount);
+		blocks = (size + CULL_BLOCK - 1) / CULL_BLOCK;
+		superblocks = (blocks + CULL_SUPERBLOCK - 1) / CULL_SUPERBLOCK;
+		blockbounds.resize(blocks * blocks);
+		superblockbounds.resize(superblocks * superblocks);
+		blockdirty = std::vector<uint8_t>(blocks * blocks, 1);
+		superblockdirty = std::vector<uint8_t>(superblocks * superblocks, 1);
+		drawcounts = std::vector<GLsizei>(chunkcount, CHUNK_VERT_COUNT);
+		drawindices = std::vector<const void*>(chunkcount, nullptr);
+		drawbasevertices = std::vector<GLint>(chunkcount);
+		targetpos = std::vector<infworld::ChunkPos>(chunkcount);
+		slotversion = std::vector<unsigned int>(chunkcount);
+		submittedversion = std::vector<unsigned int>(chunkcount);
+		builtchunks = std::make_shared<BuiltChunkQueue>();
+		char tag[64];
+		snprintf(tag, sizeof(tag), "terrain vertices (chunk scale %g)", scale);
+		memtag = tag;
 	}
 
 	void ChunkTable::genBuffers()
 	{	
-		glGenVertexArrays(vaoids.size(), &vaoids[0]);	
-		glGenBuffers(bufferids.size(), &bufferids[0]);
+		if(chunkindexusers++ == 0)
+			createChunkIndexBuffer();
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vertexbuffer);
+		glGenBuffers(1, &offsetbuffer);
+		glGenTextures(1, &offsettexture);
+
+		//Space for every slot, the chunks are copied in by addChunk
+		size_t vertexbytes = size_t(chunkcount) * CHUNK_VERTICES * sizeof(ChunkVertex);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+		glBufferData(GL_ARRAY_BUFFER, vertexbytes, nullptr, GL_DYNAMIC_DRAW);
+		mem::trackBuffer(memtag, vertexbuffer, vertexbytes);
+		//Height
+		glVertexAttribPointer(
+			0,
+			1,
+			GL_SHORT,
+			true,
+			sizeof(ChunkVertex),
+			(void*)offsetof(ChunkVertex, height)
+		);
+		glEnableVertexAttribArray(0);
+		//Normal
+		glVertexAttribPointer(
+			1,
+			2,
+			GL_SHORT, 
+			true,
+			sizeof(ChunkVertex),
+			(void*)offsetof(ChunkVertex, normal)
+		);
+		glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunkindexbuffer);
+		glBindVertexArray(0);
+
+		std::vector<float> offsets(chunkcount * 2, 0.0f);
+		glBindBuffer(GL_TEXTURE_BUFFER, offsetbuffer);
+		glBufferData(
+			GL_TEXTURE_BUFFER,
+			offsets.size() * sizeof(float),
+			&offsets[0],
+			GL_DYNAMIC_DRAW
+		);
+		mem::trackBuffer("terrain chunk offsets", offsetbuffer, offsets.size() * sizeof(float));
+		glBindTexture(GL_TEXTURE_BUFFER, offsettexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, offsetbuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
 	}
 
 	void ChunkTable::clearBuffers()
 	{
-		glDeleteVertexArrays(vaoids.size(), &vaoids[0]);
-		glDeleteBuffers(bufferids.size(), &bufferids[0]);
+		glDeleteVertexArrays(1, &vao);
+		unsigned int buffers[] = { vertexbuffer, offsetbuffer };
+		mem::untrackBuffers(buffers, 2);
+		glDeleteBuffers(2, buffers);
+		glDeleteTextures(1, &offsettexture);
+		if(--chunkindexusers == 0) {
+			mem::untrackBuffers(&chunkindexbuffer, 1);
+			glDeleteBuffers(1, &chunkindexbuffer);
+			chunkindexbuffer = 0;
+		}
 	}
 
 	void ChunkTable::addChunk(
 		unsigned int index,
-		const mesh::ElementArrayBuffer<float> &chunkmesh,
+		const ChunkMesh &chunkmesh,
 		int x,
-		int z
+		int z,
+		const ChunkHeights &heights
 	) {
+		PROFILE_SCOPE_XZ("ChunkTable::addChunk", x, z);
 		chunkpos.at(index) = { x, z };
+		targetpos.at(index) = { x, z };
 
-		glBindVertexArray(vaoids.at(index));
-
-		//Buffer 0 (vertex positions)
-		glBindBuffer(GL_ARRAY_BUFFER, bufferids.at(index * BUFFER_PER_CHUNK));
-		glBufferData(
-			GL_ARRAY_BUFFER, 
-			chunkmesh.mesh.vertices.size() * sizeof(float),
-			&chunkmesh.mesh.vertices[0],
-			GL_STATIC_DRAW
-		);
-		glVertexAttribPointer(
-			0,
-			1,
-			GL_FLOAT,
-			false,
-			CHUNK_VERT_SZ_BYTES,
-			(void*)0
-		);
-		glEnableVertexAttribArray(0);
-
-		//Buffer 1 (vertex normals)
-		glBindBuffer(GL_ARRAY_BUFFER, bufferids.at(index * BUFFER_PER_CHUNK + 1));
-		glBufferData(
+		assert(chunkmesh.size() <= CHUNK_VERTICES * sizeof(ChunkVertex));
+		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+		glBufferSubData(
 			GL_ARRAY_BUFFER,
-			chunkmesh.mesh.vertices.size() * sizeof(float),
-			&chunkmesh.mesh.vertices[0],
-			GL_STATIC_DRAW
-		);
-		glVertexAttribPointer(
-			1,
-			2,
-			GL_FLOAT, 
-			false,
-			CHUNK_VERT_SZ_BYTES,
-			(void*)(sizeof(float))
+			size_t(index) * CHUNK_VERTICES * sizeof(ChunkVertex),
+			chunkmesh.size(),
+			chunkmesh.ptr()
 		);
-		glEnableVertexAttribArray(1);
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferids.at(index * BUFFER_PER_CHUNK + 2));
-		glBufferData(
-			GL_ELEMENT_ARRAY_BUFFER,
-			chunkmesh.indices.size() * sizeof(unsigned int),
-			&chunkmesh.indices[0],
-			GL_STATIC_DRAW
+		const float offset[] = {
+			float(z) * chunkscale * 2.0f * float(PREC) / float(PREC + 1),
+			float(x) * chunkscale * 2.0f * float(PREC) / float(PREC + 1)
+		};
+		glBindBuffer(GL_TEXTURE_BUFFER, offsetbuffer);
+		glBufferSubData(GL_TEXTURE_BUFFER, index * sizeof(offset), sizeof(offset), offset);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		//The vertices of neighboring chunks meet exactly, so the chunk covers
+		//a square that is as wide as the distance between chunks (this is
+		//what lets the horizon culler treat it as solid ground)
+		float halfwidth = chunkscale * float(PREC) / float(PREC + 1);
+		bounds.set(
+			index,
+			glm::vec3(offset[0], (heights.lowest + heights.highest) * 0.5f, offset[1]) * SCALE,
+			glm::vec3(halfwidth, (heights.highest - heights.lowest) * 0.5f, halfwidth) * SCALE
 		);
+		slotheights.at(index) = heights;
+		unsigned int bx = index / size / CULL_BLOCK, bz = index % size / CULL_BLOCK;
+		blockdirty.at(bx * blocks + bz) = 1;
+		bx /= CULL_SUPERBLOCK;
+		bz /= CULL_SUPERBLOCK;
+		superblockdirty.at(bx * superblocks + bz) = 1;
 	}
 
 	void ChunkTable::addChunk(unsigned int index, const ChunkData &chunk)
 	{
-		addChunk(index, chunk.chunkmesh, chunk.position.x, chunk.position.z);
+		addChunk(
+			index,
+			chunk.chunkmesh,
+			chunk.position.x,
+			chunk.position.z,
+			chunk.heights
+		);
 	}
 
-	void ChunkTable::bindVao(unsigned int index)
-	{
-		glBindVertexArray(vaoids.at(index));
-	}	
-
 	infworld::ChunkPos ChunkTable::getPos(unsigned int index)
 	{
 		return chunkpos.at(index);
@@ -120,117 +223,457 @@ namespace infworld {
 		centerz = z;
 	}
 
-	void ChunkTable::generateNewChunks(
-		float camerax,
-		float cameraz,
-		const worldseed &permutations
+	uint64_t chunkKey(ChunkPos pos)
+	{
+		return uint64_t(uint32_t(pos.x)) << 32 | uint64_t(uint32_t(pos.z));
+	}
+
+	ChunkPos chunkAt(float x, float z, float chunkscale)
+	{
+		float chunksz = chunkscale * float(PREC) / float(PREC + 1);
+		return {
+			int(floorf((z + chunksz * SCALE) / (chunksz * SCALE * 2.0f))),
+			int(floorf((x + chunksz * SCALE) / (chunksz * SCALE * 2.0f)))
+		};
+	}
+
+	unsigned int ChunkTable::slot(int x, int z) const
+	{
+		//Wrap around so that negative coordinates also map to [0, size)
+		int sx = (x % int(size) + int(size)) % int(size);
+		int sz = (z % int(size) + int(size)) % int(size);
+		return sx * size + sz;
+	}
+
+	bool ChunkTable::hasChunk(int x, int z) const
+	{
+		if(chunkcount == 0)
+			return false;
+		ChunkPos p = chunkpos.at(slot(x, z));
+		return p.x == x && p.z == z;
+	}
+
+	void ChunkTable::queueChunk(int x, int z)
+	{
+		unsigned int index = slot(x, z);
+		targetpos.at(index) = { x, z };
+		unsigned int version = ++slotversion.at(index);
+
+		//Chunks that have been prefetched can be uploaded right away
+		{
+			std::lock_guard<std::mutex> guard(builtchunks->lock);
+			auto stagedchunk = builtchunks->staged.find(chunkKey({ x, z }));
+			if(stagedchunk != builtchunks->staged.end()) {
+				builtchunks->chunks.push_back({ index, version, std::move(stagedchunk->second) });
+				builtchunks->staged.erase(stagedchunk);
+				submittedversion.at(index) = version;
+				return;
+			}
+		}
+
+		queued.push_back({ 0, { x, z }, version, false, 0.0f, false });
+	}
+
+	void ChunkTable::getRequests(
+		unsigned int lod,
+		const glm::vec3 &camerapos,
+		const geo::Frustum &viewfrustum,
+		std::vector<ChunkRequest> &requests
 	) {
-		if(indices.size() > 0) {
-			int i = indices.size() - 1;
-			int x = newChunks.at(i).x, z = newChunks.at(i).z;
-			ChunkData chunk = buildChunk(permutations, x, z, height, chunkscale);
-			addChunk(indices.at(i), chunk);
-			indices.pop_back();
-			newChunks.pop_back();
-			return;
+		std::vector<ChunkRequest> candidates;
+		{
+			std::lock_guard<std::mutex> guard(builtchunks->lock);
+			std::vector<ChunkRequest> stillqueued;
+			for(const auto &request : queued) {
+				//Forget chunks that have been submitted or replaced
+				unsigned int index = slot(request.pos.x, request.pos.z);
+				if(request.version != slotversion.at(index) ||
+					request.version == submittedversion.at(index))
+					continue;
+
+				//Chunks that have been prefetched are ready to upload
+				uint64_t key = chunkKey(request.pos);
+				auto stagedchunk = builtchunks->staged.find(key);
+				if(stagedchunk != builtchunks->staged.end()) {
+					builtchunks->chunks.push_back({ 
+						index, 
+						request.version, 
+						std::move(stagedchunk->second) 
+					});
+					builtchunks->staged.erase(stagedchunk);
+					submittedversion.at(index) = request.version;
+					continue;
+				}
+
+				stillqueued.push_back(request);
+				//Wait for the prefetch to finish instead of building it again
+				if(!builtchunks->prefetching.count(key))
+					candidates.push_back(request);
+			}
+			queued = stillqueued;
+
+			for(const auto &pos : prefetchqueue) {
+				uint64_t key = chunkKey(pos);
+				if(builtchunks->staged.count(key) || builtchunks->prefetching.count(key))
+					continue;
+				candidates.push_back({ 0, pos, 0, false, 0.0f, true });
+			}
 		}
 
-		float chunksz = chunkscale * float(PREC) / float(PREC + 1);
-		int
-			ix = int(floorf((cameraz + chunksz * SCALE) / (chunksz * SCALE * 2.0f))),
-			iz = int(floorf((camerax + chunksz * SCALE) / (chunksz * SCALE * 2.0f)));
-		if(ix == centerx && iz == centerz)
+		for(auto request : candidates) {
+			float x = float(request.pos.z) * chunkscale * 2.0f * float(PREC) / float(PREC + 1);
+			float z = float(request.pos.x) * chunkscale * 2.0f * float(PREC) / float(PREC + 1);
+
+			geo::AABB chunkAABB = geo::AABB(
+				glm::vec3(x, 0.0f, z) * SCALE,
+				glm::vec3(chunkscale * 2.0f, HEIGHT * 2.0f, chunkscale * 2.0f) * SCALE
+			);
+
+			float dx = x * SCALE - camerapos.x, dz = z * SCALE - camerapos.z;
+			request.lod = lod;
+			request.visible = geo::intersectsFrustum(viewfrustum, chunkAABB);
+			request.distance = dx * dx + dz * dz;
+			requests.push_back(request);
+		}
+	}
+
+	void ChunkTable::submitChunk(const ChunkRequest &request, const worldseed &permutations)
+	{
+		std::shared_ptr<BuiltChunkQueue> queue = builtchunks;
+		float maxheight = height, scale = chunkscale;
+		unsigned int octavecount = octaves;
+		ChunkPos pos = request.pos;
+
+		if(request.prefetch) {
+			uint64_t key = chunkKey(pos);
+			{
+				std::lock_guard<std::mutex> guard(queue->lock);
+				queue->prefetching.insert(key);
+			}
+			jobs::WorkerPool::get()->submit(
+				[queue, &permutations, pos, key, maxheight, scale, octavecount]() {
+					ChunkData chunk = 
+						buildChunk(permutations, pos.x, pos.z, maxheight, scale, octavecount);
+					std::lock_guard<std::mutex> guard(queue->lock);
+					queue->prefetching.erase(key);
+					queue->staged[key] = std::move(chunk);
+				},
+				builtchunks->building
+			);
 			return;
+		}
+
+		unsigned int index = slot(pos.x, pos.z);
+		unsigned int version = request.version;
+		submittedversion.at(index) = version;
+		jobs::WorkerPool::get()->submit(
+			[queue, &permutations, pos, index, version, maxheight, scale, octavecount]() {
+				ChunkData chunk = 
+					buildChunk(permutations, pos.x, pos.z, maxheight, scale, octavecount);
+				std::lock_guard<std::mutex> guard(queue->lock);
+				queue->chunks.push_back({ index, version, std::move(chunk) });
+			},
+			builtchunks->building
+		);
+	}
+
+	unsigned int ChunkTable::buildingCount() const
+	{
+		return builtchunks->building.count();
+	}
+
+	unsigned int ChunkTable::readyCount() const
+	{
+		std::lock_guard<std::mutex> guard(builtchunks->lock);
+		return builtchunks->chunks.size();
+	}
+
+	ChunkPos ChunkTable::chunkAt(float x, float z) const
+	{
+		return infworld::chunkAt(x, z, chunkscale);
+	}
 
+	void ChunkTable::prefetchChunks(float predictedx, float predictedz)
+	{
+		prefetchqueue.clear();
+
+		//Only look one chunk ahead so the staging area stays small
+		ChunkPos predicted = chunkAt(predictedx, predictedz);
+		int
+			ix = std::min(std::max(predicted.x, centerx - 1), centerx + 1),
+			iz = std::min(std::max(predicted.z, centerz - 1), centerz + 1);
 		int range = (size - 1) / 2;
 		for(int x = ix - range; x <= ix + range; x++) {
 			for(int z = iz - range; z <= iz + range; z++) {
 				if(labs(x - centerx) <= range && labs(z - centerz) <= range)
 					continue;
-				newChunks.push_back({ x, z });
+				prefetchqueue.push_back({ x, z });
 			}
 		}
 
-		//Determine which chunks are out of range
-		for(int i = 0; i < chunkcount; i++) {
-			int 
-				chunkx = chunkpos.at(i).x,
-				chunkz = chunkpos.at(i).z;	
-			if(labs(ix - chunkx) <= range && labs(iz - chunkz) <= range)
-				continue;
-			indices.push_back(i);
-		}	
+		//Throw away staged chunks that are no longer expected to be needed
+		std::lock_guard<std::mutex> guard(builtchunks->lock);
+		auto &staged = builtchunks->staged;
+		for(auto it = staged.begin(); it != staged.end(); ) {
+			ChunkPos pos = it->second.position;
+			bool predicted = labs(pos.x - ix) <= range && labs(pos.z - iz) <= range;
+			bool current = labs(pos.x - centerx) <= range && labs(pos.z - centerz) <= range;
+			if(!predicted && !current)
+				it = staged.erase(it);
+			else
+				it++;
+		}
+	}
+
+	void ChunkTable::generateNewChunks(float camerax, float cameraz)
+	{
+		PROFILE_SCOPE("ChunkTable::generateNewChunks");
+		ChunkPos center = chunkAt(camerax, cameraz);
+		int ix = center.x, iz = center.z;
+		if(ix == centerx && iz == centerz)
+			return;
+
+		//Only the chunks that are in range of the new center but were not
+		//in range of the old one need to be built, each of them replaces
+		//the chunk in its slot (which just went out of range)
+		int range = (size - 1) / 2;
+		for(int x = ix - range; x <= ix + range; x++) {
+			int minz = iz - range, maxz = iz + range;
+			//Rows that were already in range only need their new columns
+			if(labs(x - centerx) <= range) {
+				if(iz > centerz)
+					minz = std::max(minz, centerz + range + 1);
+				else
+					maxz = std::min(maxz, centerz - range - 1);
+			}
+
+			for(int z = minz; z <= maxz; z++)
+				queueChunk(x, z);
+		}
 
 		centerx = ix;
 		centerz = iz;
 	}
 
-	unsigned int ChunkTable::draw(
-		ShaderProgram &shader,
-		const geo::Frustum &viewfrustum
-	) {
-		unsigned int drawCount = 0;
-		for(int i = 0; i < count(); i++) {
-			infworld::ChunkPos p = getPos(i);
+	unsigned int ChunkTable::uploadChunks(unsigned int maxcount)
+	{
+		std::vector<BuiltChunkQueue::BuiltChunk> ready;
+		{
+			std::lock_guard<std::mutex> guard(builtchunks->lock);
+			auto &chunks = builtchunks->chunks;
+			unsigned int n = std::min<size_t>(maxcount, chunks.size());
+			std::move(chunks.begin(), chunks.begin() + n, std::back_inserter(ready));
+			chunks.erase(chunks.begin(), chunks.begin() + n);
+		}
 
-			float x = float(p.z) * chunkscale * 2.0f * float(PREC) / float(PREC + 1);
-			float z = float(p.x) * chunkscale * 2.0f * float(PREC) / float(PREC + 1);	
+		//Chunks whose slot was given a new target while they were being
+		//built are outdated and get discarded
+		unsigned int uploaded = 0;
+		for(const auto &built : ready) {
+			if(built.version != slotversion.at(built.index))
+				continue;
+			addChunk(built.index, built.chunk);
+			uploaded++;
+		}
 
-			geo::AABB chunkAABB = geo::AABB(
-				glm::vec3(x, 0.0f, z) * SCALE,
-				glm::vec3(chunkscale * 2.0f, HEIGHT * 2.0f, chunkscale * 2.0f) * SCALE
-			);
+		return uploaded;
+	}
 
-			if(!geo::intersectsFrustum(viewfrustum, chunkAABB))
-				continue;
+	unsigned int ChunkTable::pendingCount() const
+	{
+		unsigned int pending = 0;
+		for(unsigned int i = 0; i < chunkcount; i++) {
+			if(chunkpos.at(i).x != targetpos.at(i).x || chunkpos.at(i).z != targetpos.at(i).z)
+				pending++;
+		}
+		return pending;
+	}
+
+	void ChunkTable::waitForPending()
+	{
+		jobs::WorkerPool::get()->wait(builtchunks->building);
+	}
+
+	//Grows the box (lower, upper) to contain box i of 'boxes'
+	void growBox(glm::vec3 &lower, glm::vec3 &upper, const geo::AABBList &boxes, size_t i)
+	{
+		glm::vec3 center = boxes.center(i), extent = boxes.extent(i);
+		lower = glm::min(lower, center - extent);
+		upper = glm::max(upper, center + extent);
+	}
 
-			glm::mat4 transform = glm::mat4(1.0f);
-			transform = glm::scale(transform, glm::vec3(SCALE));
-			transform = glm::translate(transform, glm::vec3(x, 0.0f, z));
-			shader.uniformMat4x4("transform", transform);
-			bindVao(i);
-			glDrawElements(GL_TRIANGLES, CHUNK_VERT_COUNT, GL_UNSIGNED_INT, 0);
-			drawCount++;
+	void ChunkTable::updateCullBounds()
+	{
+		for(unsigned int bx = 0; bx < blocks; bx++) {
+			for(unsigned int bz = 0; bz < blocks; bz++) {
+				unsigned int block = bx * blocks + bz;
+				if(!blockdirty[block])
+					continue;
+				blockdirty[block] = 0;
+				glm::vec3 lower(INFINITY), upper(-INFINITY);
+				unsigned int endx = std::min(size, (bx + 1) * CULL_BLOCK);
+				unsigned int endz = std::min(size, (bz + 1) * CULL_BLOCK);
+				for(unsigned int sx = bx * CULL_BLOCK; sx < endx; sx++)
+					for(unsigned int sz = bz * CULL_BLOCK; sz < endz; sz++)
+						growBox(lower, upper, bounds, sx * size + sz);
+				blockbounds.set(block, (lower + upper) * 0.5f, (upper - lower) * 0.5f);
+			}
 		}
 
-		return drawCount;
+		for(unsigned int sbx = 0; sbx < superblocks; sbx++) {
+			for(unsigned int sbz = 0; sbz < superblocks; sbz++) {
+				unsigned int superblock = sbx * superblocks + sbz;
+				if(!superblockdirty[superblock])
+					continue;
+				superblockdirty[superblock] = 0;
+				glm::vec3 lower(INFINITY), upper(-INFINITY);
+				unsigned int endx = std::min(blocks, (sbx + 1) * CULL_SUPERBLOCK);
+				unsigned int endz = std::min(blocks, (sbz + 1) * CULL_SUPERBLOCK);
+				for(unsigned int bx = sbx * CULL_SUPERBLOCK; bx < endx; bx++)
+					for(unsigned int bz = sbz * CULL_SUPERBLOCK; bz < endz; bz++)
+						growBox(lower, upper, blockbounds, bx * blocks + bz);
+				superblockbounds.set(superblock, (lower + upper) * 0.5f, (upper - lower) * 0.5f);
+			}
+		}
 	}
 
-	unsigned int ChunkTable::draw(
-		ShaderProgram &shader,
+	unsigned int ChunkTable::cullBlock(
+		unsigned int bx,
+		unsigned int bz,
+		unsigned int planemask,
 		unsigned int minrange,
-		const geo::Frustum &viewfrustum
+		const geo::Frustum &viewfrustum,
+		unsigned int visible
 	) {
-		unsigned int drawCount = 0;
-		for(int i = 0; i < count(); i++) {
-			infworld::ChunkPos p = getPos(i);
+		unsigned int block = bx * blocks + bz;
+		glm::vec3 center = blockbounds.center(block), extent = blockbounds.extent(block);
+		if(planemask && !geo::cullBox(viewfrustum, center, extent, planemask))
+			return visible;
+
+		unsigned int endx = std::min(size, (bx + 1) * CULL_BLOCK);
+		unsigned int startz = bz * CULL_BLOCK, endz = std::min(size, (bz + 1) * CULL_BLOCK);
+		for(unsigned int sx = bx * CULL_BLOCK; sx < endx; sx++) {
+			//Slots in a row of a block are next to each other
+			uint32_t slots[CULL_BLOCK];
+			size_t count = 0;
+			if(planemask == 0) {
+				//The whole block is inside of the frustum
+				for(unsigned int sz = startz; sz < endz; sz++)
+					slots[count++] = sx * size + sz;
+			}
+			else {
+				count = geo::cullBatch(
+					viewfrustum,
+					planemask,
+					bounds,
+					sx * size + startz,
+					endz - startz,
+					slots
+				);
+			}
 
-			if(std::abs(p.x - centerx) < minrange && 
-				std::abs(p.z - centerz) < minrange)
-				continue;
+			for(size_t j = 0; j < count; j++) {
+				const infworld::ChunkPos &p = chunkpos[slots[j]];
+				if(std::abs(p.x - centerx) < minrange && 
+					std::abs(p.z - centerz) < minrange)
+					continue;
+				drawbasevertices[visible++] = slots[j] * CHUNK_VERTICES;
+			}
+		}
+		return visible;
+	}
 
-			float x = float(p.z) * chunkscale * 2.0f * float(PREC) / float(PREC + 1);
-			float z = float(p.x) * chunkscale * 2.0f * float(PREC) / float(PREC + 1);	
-		
-			geo::AABB chunkAABB = geo::AABB(
-				glm::vec3(x, 0.0f, z) * SCALE,
-				glm::vec3(chunkscale * 2.0f, HEIGHT * 2.0f, chunkscale * 2.0f) * SCALE
-			);
-			
-			//Frustum culling
-			if(!geo::intersectsFrustum(viewfrustum, chunkAABB))
-				continue;
+	unsigned int ChunkTable::cull(unsigned int minrange, const geo::Frustum &viewfrustum)
+	{
+		updateCullBounds();
+		//Superblocks and blocks that are completely in front of a plane
+		//pass that plane on to their chunks so they are not tested against it
+		unsigned int visible = 0;
+		for(unsigned int sbx = 0; sbx < superblocks; sbx++) {
+			for(unsigned int sbz = 0; sbz < superblocks; sbz++) {
+				unsigned int superblock = sbx * superblocks + sbz;
+				unsigned int planemask = geo::ALL_PLANES;
+				glm::vec3
+					center = superblockbounds.center(superblock),
+					extent = superblockbounds.extent(superblock);
+				if(!geo::cullBox(viewfrustum, center, extent, planemask))
+					continue;
 
-			glm::mat4 transform = glm::mat4(1.0f);
-			transform = glm::scale(transform, glm::vec3(SCALE));
-			transform = glm::translate(transform, glm::vec3(x, 0.0f, z));
-			shader.uniformMat4x4("transform", transform);
-			bindVao(i);
-			glDrawElements(GL_TRIANGLES, CHUNK_VERT_COUNT, GL_UNSIGNED_INT, 0);
-			drawCount++;
+				unsigned int endx = std::min(blocks, (sbx + 1) * CULL_SUPERBLOCK);
+				unsigned int endz = std::min(blocks, (sbz + 1) * CULL_SUPERBLOCK);
+				for(unsigned int bx = sbx * CULL_SUPERBLOCK; bx < endx; bx++)
+					for(unsigned int bz = sbz * CULL_SUPERBLOCK; bz < endz; bz++)
+						visible = cullBlock(bx, bz, planemask, minrange, viewfrustum, visible);
+			}
 		}
+		visiblecount = visible;
+		return visiblecount;
+	}
+
+	unsigned int ChunkTable::draw()
+	{
+		if(visiblecount == 0)
+			return 0;
+
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_BUFFER, offsettexture);
+		glActiveTexture(GL_TEXTURE0);
+		glBindVertexArray(vao);
+		glMultiDrawElementsBaseVertex(
+			GL_TRIANGLES,
+			&drawcounts[0],
+			GL_UNSIGNED_SHORT,
+			&drawindices[0],
+			visiblecount,
+			&drawbasevertices[0]
+		);
 
-		return drawCount;
+		return visiblecount;
+	}
+
+	unsigned int ChunkTable::visibleCount() const
+	{
+		return visiblecount;
+	}
+
+	unsigned int ChunkTable::visibleSlot(unsigned int i) const
+	{
+		return drawbasevertices.at(i) / CHUNK_VERTICES;
+	}
+
+	unsigned int ChunkTable::removeHidden(const std::vector<uint8_t> &hidden)
+	{
+		unsigned int kept = 0;
+		for(unsigned int i = 0; i < visiblecount; i++)
+			if(!hidden.at(i))
+				drawbasevertices[kept++] = drawbasevertices[i];
+		visiblecount = kept;
+		return visiblecount;
+	}
+
+	const geo::AABBList& ChunkTable::slotBounds() const
+	{
+		return bounds;
+	}
+
+	const ChunkHeights& ChunkTable::slotHeights(unsigned int index) const
+	{
+		return slotheights.at(index);
+	}
+
+	float ChunkTable::highestAt(float x, float z) const
+	{
+		ChunkPos p = chunkAt(x, z);
+		if(!hasChunk(p.x, p.z))
+			return INFINITY;
+		unsigned int i = slot(p.x, p.z);
+		//Cell that contains the point
+		float cellsz = bounds.extentx[i] * 2.0f / float(HEIGHT_CELLS);
+		int cellx = int(floorf((x - bounds.x[i] + bounds.extentx[i]) / cellsz));
+		int cellz = int(floorf((z - bounds.z[i] + bounds.extentz[i]) / cellsz));
+		cellx = std::clamp(cellx, 0, int(HEIGHT_CELLS) - 1);
+		cellz = std::clamp(cellz, 0, int(HEIGHT_CELLS) - 1);
+		return slotheights[i].cellhighest[cellz * HEIGHT_CELLS + cellx] * SCALE;
 	}
 
 	float ChunkTable::scale() const
@@ -242,4 +685,66 @@ namespace infworld {
 	{
 		return (size - 1) / 2;
 	}
+
+	unsigned int ChunkTable::octaveCount() const
+	{
+		return octaves;
+	}
+
+	size_t ChunkTable::indexBytesSaved() const
+	{
+		size_t unshared = size_t(chunkcount) * CHUNK_VERT_COUNT * sizeof(unsigned int);
+		size_t shared = CHUNK_VERT_COUNT * sizeof(uint16_t);
+		return unshared - std::min(shared, unshared);
+	}
+
+	size_t ChunkTable::stagingBytes() const
+	{
+		std::lock_guard<std::mutex> guard(builtchunks->lock);
+		size_t bytes = 0;
+		for(const auto &built : builtchunks->chunks)
+			bytes += built.chunk.chunkmesh.vertices.capacity() * sizeof(ChunkVertex);
+		for(const auto &staged : builtchunks->staged)
+			bytes += staged.second.chunkmesh.vertices.capacity() * sizeof(ChunkVertex);
+		return bytes;
+	}
+
+	void submitChunks(
+		ChunkTable *tables,
+		unsigned int count,
+		const glm::vec3 &camerapos,
+		const geo::Frustum &viewfrustum,
+		unsigned int maxbuilding,
+		const worldseed &permutations
+	) {
+		PROFILE_SCOPE("submitChunks");
+		unsigned int building = 0;
+		std::vector<ChunkRequest> requests;
+		for(unsigned int i = 0; i < count; i++) {
+			building += tables[i].buildingCount();
+			tables[i].getRequests(i, camerapos, viewfrustum, requests);
+		}
+
+		if(building >= maxbuilding || requests.empty())
+			return;
+
+		unsigned int n = std::min<size_t>(maxbuilding - building, requests.size());
+		std::partial_sort(
+			requests.begin(),
+			requests.begin() + n,
+			requests.end(),
+			[](const ChunkRequest &a, const ChunkRequest &b) {
+				//Chunks that are needed now go before prefetched chunks
+				if(a.prefetch != b.prefetch)
+					return b.prefetch;
+				if(a.visible != b.visible)
+					return a.visible;
+				if(a.distance != b.distance)
+					return a.distance < b.distance;
+				return a.lod < b.lod;
+			}
+		);
+		for(unsigned int i = 0; i < n; i++)
+			tables[requests.at(i).lod].submitChunk(requests.at(i), permutations);
+	}
 }
@@ -0,0 +1,91 @@
+/*
+ * Fractal brownian motion (the sum of the noise octaves used for the
+ * terrain height) specialized for a fixed number of octaves.
+ *
+ * The octave loop is unrolled at compile time, every octave divides by a
+ * frequency known at compile time and the noise is inlined, reading its
+ * permutation from worldseed::interleaved so that every octave's table
+ * lives in the same small block of memory.
+ * */
+
+#pragma once
+#include <stdint.h>
+#include <utility>
+#include "noise.hpp"
+#include "infworld.hpp"
+
+namespace perlin {
+	//Same as perlin::noise but entry i of the permutation is read from
+	//p[i * Stride] (stride is the number of interleaved octaves)
+	template<unsigned int Stride>
+	inline float noiseInterleaved(float x, float y, const uint8_t *p)
+	{
+		const float gradx[4] = { 1.0f, -1.0f, 0.0f, 0.0f };
+		const float grady[4] = { 0.0f, 0.0f, 1.0f, -1.0f };
+		auto dotgradient = [p, &gradx, &grady](int gridx, int gridy, float x, float y) {
+			//Same hash as perlin::gradient
+			const unsigned w = 8 * sizeof(unsigned);
+			const unsigned s = w / 2;
+			unsigned a = gridx, b = gridy;
+			a *= 3284157443;
+			b ^= a << s | a >> (w-s);
+			b *= 1911520717;
+			a ^= b << s | b >> (w-s);
+			a *= 2048419325;
+
+			int index = p[(unsigned(p[(unsigned(p[(a % 256) * Stride] + b) % 256) * Stride]) % 256) * Stride];
+			float dx = x - float(gridx), dy = y - float(gridy);
+			return gradx[index % 4] * dx + grady[index % 4] * dy;
+		};
+		auto interpolate = [](float a, float b, float x) -> float {
+			return (b - a) * (3.0 - x * 2.0) * x * x + a;
+		};
+
+		int
+			leftx = int(floorf(x)),
+			lowery = int(floorf(y)),
+			rightx = leftx + 1,
+			uppery = lowery + 1;
+		float
+			lowerleft = dotgradient(leftx, lowery, x, y),
+			lowerright = dotgradient(rightx, lowery, x, y),
+			upperleft = dotgradient(leftx, uppery, x, y),
+			upperright = dotgradient(rightx, uppery, x, y);
+		float
+			lerpedlower = interpolate(lowerleft, lowerright, x - leftx),
+			lerpedupper = interpolate(upperleft, upperright, x - leftx);
+		return interpolate(lerpedlower, lerpedupper, y - lowery);
+	}
+}
+
+namespace infworld {
+	template<unsigned int Octaves, unsigned int Octave>
+	inline float fbmOctave(float x, float z, const uint8_t *table)
+	{
+		//Dividing by a power of two is exact so this is the same frequency
+		//as halving it once per octave like the loop in getHeight does
+		constexpr float freq = FREQUENCY / float(1u << Octave);
+		constexpr float amplitude = 1.0f / float(1u << Octave);
+		return perlin::noiseInterleaved<Octaves>(x / freq, z / freq, table + Octave) * amplitude;
+	}
+
+	template<unsigned int Octaves, unsigned int... Octave>
+	inline float fbm(
+		float x,
+		float z,
+		const uint8_t *table,
+		std::integer_sequence<unsigned int, Octave...>
+	) {
+		//Left fold so that the octaves are summed in the same order as the
+		//loop in getHeight
+		return (0.0f + ... + fbmOctave<Octaves, Octave>(x, z, table));
+	}
+
+	//Sum of the first 'Octaves' octaves of noise at (x, z), 'table' is
+	//worldseed::interleaved and the seed must have exactly Octaves octaves
+	template<unsigned int Octaves>
+	inline float fbm(float x, float z, const uint8_t *table)
+	{
+		return fbm<Octaves>(x, z, table, std::make_integer_sequence<unsigned int, Octaves>());
+	}
+}
@@ -0,0 +1,111 @@
+#include "flightrecorder.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+namespace prof {
+	struct FrameRecord {
+		std::vector<TraceEvent> events;
+		unsigned int dropped = 0;
+	};
+
+	//Only touched by the thread that calls collect() and endFrame()
+	std::vector<FrameRecord> flighthistory;
+	//Index of the frame currently being recorded in flighthistory
+	unsigned int flightcurrent = 0;
+	unsigned long framenumber = 0;
+	float flightthreshold = 0.0f;
+	std::string flightprefix;
+	//Frames left to record before the pending dump is written,
+	//0 if there is no pending dump
+	unsigned int framesuntildump = 0;
+	unsigned long slowframe = 0;
+	float slowframetime = 0.0f;
+	unsigned int dumpcount = 0;
+
+	void startFlightRecorder(float thresholdms, const char *prefix)
+	{
+		flighthistory.clear();
+		flighthistory.resize(FLIGHT_HISTORY);
+		for(auto &frame : flighthistory)
+			frame.events.reserve(FLIGHT_MAX_SAMPLES);
+		flightcurrent = 0;
+		flightthreshold = thresholdms;
+		flightprefix = prefix;
+	}
+
+	bool flightRecording()
+	{
+		return !flighthistory.empty();
+	}
+
+	void flightSample(const Sample &sample, uint32_t threadid)
+	{
+		FrameRecord &frame = flighthistory.at(flightcurrent);
+		if(frame.events.size() >= FLIGHT_MAX_SAMPLES) {
+			frame.dropped++;
+			return;
+		}
+		frame.events.push_back({ sample, threadid });
+	}
+
+	void dumpFlightHistory()
+	{
+		//Oldest frame first
+		std::vector<TraceEvent> events;
+		unsigned int dropped = 0;
+		for(unsigned int i = 1; i <= FLIGHT_HISTORY; i++) {
+			const FrameRecord &frame = flighthistory.at((flightcurrent + i) % FLIGHT_HISTORY);
+			events.insert(events.end(), frame.events.begin(), frame.events.end());
+			dropped += frame.dropped;
+		}
+		if(events.empty())
+			return;
+
+		uint64_t start = events.front().sample.start;
+		for(const auto &event : events)
+			start = std::min(start, event.sample.start);
+
+		std::string path = flightprefix + std::to_string(slowframe) + ".json";
+		if(!writeTrace(path.c_str(), events, start))
+			return;
+		fprintf(
+			stderr,
+			"Frame %lu took %.2f ms, wrote the last %u frames to %s",
+			slowframe,
+			slowframetime,
+			FLIGHT_HISTORY,
+			path.c_str()
+		);
+		if(dropped > 0)
+			fprintf(stderr, " (%u samples dropped)", dropped);
+		fprintf(stderr, "\n");
+		dumpcount++;
+	}
+
+	void endFrame(float frametimems)
+	{
+		if(!flightRecording())
+			return;
+
+		if(frametimems > flightthreshold && framesuntildump == 0 && dumpcount < FLIGHT_MAX_DUMPS) {
+			framesuntildump = FLIGHT_AFTER + 1;
+			slowframe = framenumber;
+			slowframetime = frametimems;
+		}
+
+		if(framesuntildump > 0) {
+			framesuntildump--;
+			if(framesuntildump == 0)
+				dumpFlightHistory();
+		}
+
+		framenumber++;
+		flightcurrent = (flightcurrent + 1) % FLIGHT_HISTORY;
+		FrameRecord &next = flighthistory.at(flightcurrent);
+		next.events.clear();
+		next.dropped = 0;
+	}
+}
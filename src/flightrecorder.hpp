@@ -0,0 +1,37 @@
+/*
+ * Keeps the phase timer samples (see profiler.hpp) of the last few frames
+ * in memory and writes them out as a trace (see trace.hpp) whenever a
+ * frame takes longer than a threshold, so that rare hitches can be looked
+ * at after the fact without having to trace the whole session.
+ *
+ * Samples are attributed to the frame in which prof::collect() drained
+ * them. A dump covers FLIGHT_HISTORY frames: the slow frame, the frames
+ * leading up to it and FLIGHT_AFTER frames after it (chunks that were
+ * queued by the slow frame usually finish building a few frames later).
+ * Samples with a chunk position record which chunks were built, uploaded
+ * and had their decorations regenerated.
+ * */
+
+#pragma once
+#include <stdint.h>
+#include "profiler.hpp"
+
+namespace prof {
+	//Number of frames that are kept in memory
+	constexpr unsigned int FLIGHT_HISTORY = 120;
+	//Number of frames recorded after a slow frame before it is dumped
+	constexpr unsigned int FLIGHT_AFTER = 10;
+	//Samples kept per frame, the rest are counted but dropped
+	constexpr unsigned int FLIGHT_MAX_SAMPLES = 1024;
+	//Dumps written per run, so that a slow machine does not fill the disk
+	constexpr unsigned int FLIGHT_MAX_DUMPS = 16;
+
+	//Starts keeping frame history, frames that take longer than
+	//'thresholdms' are dumped to '<prefix><frame number>.json'
+	void startFlightRecorder(float thresholdms, const char *prefix);
+	bool flightRecording();
+	//Called by collect() for every sample while the flight recorder is on
+	void flightSample(const Sample &sample, uint32_t threadid);
+	//Ends the current frame, call once per frame after collect()
+	void endFrame(float frametimems);
+}
@@ -1,6 +1,21 @@
 #include "geometry.hpp"
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace geo {
+	//Planes of a frustum in plane mask order
+	Plane Frustum::* const FRUSTUM_PLANES[] = {
+		&Frustum::back,
+		&Frustum::front,
+		&Frustum::top,
+		&Frustum::bottom,
+		&Frustum::left,
+		&Frustum::right,
+	};
+	const unsigned int FRUSTUM_PLANE_COUNT = 6;
+
 	Plane::Plane(float dist, glm::vec3 normal)
 	{
 		d = dist;
@@ -19,6 +34,41 @@ namespace geo {
 		dimensions = size;
 	}
 
+	void AABBList::resize(size_t count)
+	{
+		x.resize(count);
+		y.resize(count);
+		z.resize(count);
+		extentx.resize(count);
+		extenty.resize(count);
+		extentz.resize(count);
+	}
+
+	size_t AABBList::size() const
+	{
+		return x.size();
+	}
+
+	void AABBList::set(size_t i, const glm::vec3 &center, const glm::vec3 &extent)
+	{
+		x.at(i) = center.x;
+		y.at(i) = center.y;
+		z.at(i) = center.z;
+		extentx.at(i) = extent.x;
+		extenty.at(i) = extent.y;
+		extentz.at(i) = extent.z;
+	}
+
+	glm::vec3 AABBList::center(size_t i) const
+	{
+		return glm::vec3(x[i], y[i], z[i]);
+	}
+
+	glm::vec3 AABBList::extent(size_t i) const
+	{
+		return glm::vec3(extentx[i], extenty[i], extentz[i]);
+	}
+
 	float signedDist(const Plane &p, const glm::vec3 &pos)
 	{
 		return glm::dot(pos, p.norm) - p.d;
@@ -31,19 +81,123 @@ namespace geo {
 
 	bool inFront(const Plane &p, const AABB &aabb)
 	{
-		glm::vec3 extent = aabb.dimensions / 2.0f;
+		return inFront(p, aabb.pos, aabb.dimensions / 2.0f);
+	}
+
+	bool inFront(const Plane &p, const glm::vec3 &center, const glm::vec3 &extent)
+	{
 		float r = glm::dot(glm::abs(p.norm), extent);
-		return signedDist(p, aabb.pos) >= -r;
+		return signedDist(p, center) >= -r;
 	}
 
 	bool intersectsFrustum(const Frustum &frustum, const AABB &aabb)
+	{
+		return intersectsFrustum(frustum, aabb.pos, aabb.dimensions / 2.0f);
+	}
+
+	bool intersectsFrustum(const Frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent)
 	{
 		return
-			inFront(frustum.back, aabb) &&
-			inFront(frustum.front, aabb) &&
-			inFront(frustum.left, aabb) &&
-			inFront(frustum.right, aabb) &&
-			inFront(frustum.top, aabb) &&
-			inFront(frustum.bottom, aabb);
+			inFront(frustum.back, center, extent) &&
+			inFront(frustum.front, center, extent) &&
+			inFront(frustum.left, center, extent) &&
+			inFront(frustum.right, center, extent) &&
+			inFront(frustum.top, center, extent) &&
+			inFront(frustum.bottom, center, extent);
+	}
+
+	bool cullBox(
+		const Frustum &frustum,
+		const glm::vec3 &center,
+		const glm::vec3 &extent,
+		unsigned int &planemask
+	) {
+		for(unsigned int i = 0; i < FRUSTUM_PLANE_COUNT; i++) {
+			if(!(planemask & (1 << i)))
+				continue;
+			const Plane &p = frustum.*FRUSTUM_PLANES[i];
+			float r = glm::dot(glm::abs(p.norm), extent);
+			float dist = signedDist(p, center);
+			if(dist < -r)
+				return false;
+			if(dist >= r)
+				planemask &= ~(1 << i);
+		}
+		return true;
+	}
+
+	size_t cullBatch(
+		const Frustum &frustum,
+		unsigned int planemask,
+		const AABBList &boxes,
+		size_t begin,
+		size_t count,
+		uint32_t *visible
+	) {
+		const Plane *planes[FRUSTUM_PLANE_COUNT];
+		unsigned int planecount = 0;
+		for(unsigned int i = 0; i < FRUSTUM_PLANE_COUNT; i++)
+			if(planemask & (1 << i))
+				planes[planecount++] = &(frustum.*FRUSTUM_PLANES[i]);
+
+		size_t visiblecount = 0;
+		size_t i = 0;
+#if defined(__SSE2__)
+		__m128 nx[FRUSTUM_PLANE_COUNT], ny[FRUSTUM_PLANE_COUNT], nz[FRUSTUM_PLANE_COUNT];
+		__m128 absnx[FRUSTUM_PLANE_COUNT], absny[FRUSTUM_PLANE_COUNT], absnz[FRUSTUM_PLANE_COUNT];
+		__m128 d[FRUSTUM_PLANE_COUNT];
+		for(unsigned int p = 0; p < planecount; p++) {
+			nx[p] = _mm_set1_ps(planes[p]->norm.x);
+			ny[p] = _mm_set1_ps(planes[p]->norm.y);
+			nz[p] = _mm_set1_ps(planes[p]->norm.z);
+			absnx[p] = _mm_set1_ps(std::abs(planes[p]->norm.x));
+			absny[p] = _mm_set1_ps(std::abs(planes[p]->norm.y));
+			absnz[p] = _mm_set1_ps(std::abs(planes[p]->norm.z));
+			d[p] = _mm_set1_ps(planes[p]->d);
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+		for(; i + 4 <= count; i += 4) {
+			size_t b = begin + i;
+			__m128
+				x = _mm_loadu_ps(&boxes.x[b]),
+				y = _mm_loadu_ps(&boxes.y[b]),
+				z = _mm_loadu_ps(&boxes.z[b]),
+				ex = _mm_loadu_ps(&boxes.extentx[b]),
+				ey = _mm_loadu_ps(&boxes.extenty[b]),
+				ez = _mm_loadu_ps(&boxes.extentz[b]);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for(unsigned int p = 0; p < planecount; p++) {
+				//Signed distance of the center + projected radius of the box
+				__m128 dist = _mm_sub_ps(
+					_mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(x, nx[p]), _mm_mul_ps(y, ny[p])),
+						_mm_mul_ps(z, nz[p])
+					),
+					d[p]
+				);
+				__m128 r = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(ex, absnx[p]), _mm_mul_ps(ey, absny[p])),
+					_mm_mul_ps(ez, absnz[p])
+				);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, r), zero));
+			}
+
+			int bits = _mm_movemask_ps(inside);
+			for(unsigned int j = 0; j < 4; j++)
+				if(bits & (1 << j))
+					visible[visiblecount++] = b + j;
+		}
+#endif
+		for(; i < count; i++) {
+			size_t b = begin + i;
+			glm::vec3 center = boxes.center(b), extent = boxes.extent(b);
+			bool inside = true;
+			for(unsigned int p = 0; p < planecount && inside; p++)
+				inside = inFront(*planes[p], center, extent);
+			if(inside)
+				visible[visiblecount++] = b;
+		}
+		return visiblecount;
 	}
 }
@@ -1,4 +1,7 @@
 #include <glm/glm.hpp>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
 #pragma once
 
 namespace geo {
@@ -16,6 +19,20 @@ namespace geo {
 		AABB(glm::vec3 position, glm::vec3 size);
 	};
 
+	//List of AABBs stored as one array per component so that code that
+	//only needs some of the values (culling) can read them contiguously
+	struct AABBList {
+		//Centers
+		std::vector<float> x, y, z;
+		//Half of the size along each axis
+		std::vector<float> extentx, extenty, extentz;
+		void resize(size_t count);
+		size_t size() const;
+		void set(size_t i, const glm::vec3 &center, const glm::vec3 &extent);
+		glm::vec3 center(size_t i) const;
+		glm::vec3 extent(size_t i) const;
+	};
+
 	struct Frustum {
 		Plane
 			back,
@@ -26,8 +43,37 @@ namespace geo {
 			right;
 	};
 
+	//Bit i of a plane mask is the i-th plane of Frustum
+	//(back, front, top, bottom, left, right)
+	constexpr unsigned int ALL_PLANES = 0x3f;
+
 	float signedDist(const Plane &p, const glm::vec3 &pos);
 	bool inFront(const Plane &p, const glm::vec3 &pos);
 	bool inFront(const Plane &p, const AABB &aabb);
+	//Same as above for a box given by its center and half size
+	bool inFront(const Plane &p, const glm::vec3 &center, const glm::vec3 &extent);
 	bool intersectsFrustum(const Frustum &frustum, const AABB &aabb);
+	bool intersectsFrustum(const Frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent);
+	//Tests a box against the planes in 'planemask', returns false if it is
+	//completely behind one of them. Planes that the box is completely in
+	//front of are cleared from 'planemask' since anything inside of the
+	//box does not need to be tested against them
+	bool cullBox(
+		const Frustum &frustum,
+		const glm::vec3 &center,
+		const glm::vec3 &extent,
+		unsigned int &planemask
+	);
+	//Tests boxes [begin, begin + count) against the planes in 'planemask'
+	//(4 at a time with SSE), writes the index of every box that is at
+	//least partly in front of all of them to 'visible' and returns how
+	//many were written. 'visible' needs space for 'count' indices
+	size_t cullBatch(
+		const Frustum &frustum,
+		unsigned int planemask,
+		const AABBList &boxes,
+		size_t begin,
+		size_t count,
+		uint32_t *visible
+	);
 };
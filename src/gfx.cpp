@@ -1,9 +1,11 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include "gfx.hpp"
+#include "memledger.hpp"
 #include <stdio.h>
 #include <stb_image/stb_image.h>
 #include <assert.h>
+#include <algorithm>
 
 namespace mesh {
 	void addToMesh(Meshf &mesh, const glm::vec3 &v)
@@ -34,16 +36,19 @@ namespace mesh {
 		//vertex positions
 		glBindBuffer(GL_ARRAY_BUFFER, buffers.at(0));	
 		glBufferData(GL_ARRAY_BUFFER, vertdata.size(), vertdata.ptr(), GL_STATIC_DRAW);
+		mem::trackBuffer("models", buffers.at(0), vertdata.size());
 		glVertexAttribPointer(0, 3, GL_FLOAT, false, 3 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(0);
 		//texture coordinates
 		glBindBuffer(GL_ARRAY_BUFFER, buffers.at(1));
 		glBufferData(GL_ARRAY_BUFFER, tcdata.size(), tcdata.ptr(), GL_STATIC_DRAW);	
+		mem::trackBuffer("models", buffers.at(1), tcdata.size());
 		glVertexAttribPointer(1, 2, GL_FLOAT, false, 2 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(1);
 		//normals
 		glBindBuffer(GL_ARRAY_BUFFER, buffers.at(2));	
 		glBufferData(GL_ARRAY_BUFFER, normData.size(), normData.ptr(), GL_STATIC_DRAW);	
+		mem::trackBuffer("models", buffers.at(2), normData.size());
 		glVertexAttribPointer(2, 3, GL_FLOAT, false, 3 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(2);
 		//indices
@@ -54,6 +59,7 @@ namespace mesh {
 			&indices[0],
 			GL_STATIC_DRAW
 		);
+		mem::trackBuffer("models", buffers.at(3), indices.size() * sizeof(unsigned int));
 	}
 
 	Model createConeModel1(unsigned int prec)
@@ -342,6 +348,8 @@ namespace gfx {
 		glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD), QUAD, GL_STATIC_DRAW);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadvao.buffers[1]);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(QUAD_INDICES), QUAD_INDICES, GL_STATIC_DRAW);
+		mem::trackBuffer("models", quadvao.buffers[0], sizeof(QUAD));
+		mem::trackBuffer("models", quadvao.buffers[1], sizeof(QUAD_INDICES));
 		glVertexAttribPointer(0, 3, GL_FLOAT, false, 3 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(0);
 		glBindVertexArray(0);
@@ -392,6 +400,8 @@ namespace gfx {
 		glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE), CUBE, GL_STATIC_DRAW);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubevao.buffers[1]);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(CUBE_INDICES), CUBE_INDICES, GL_STATIC_DRAW);
+		mem::trackBuffer("models", cubevao.buffers[0], sizeof(CUBE));
+		mem::trackBuffer("models", cubevao.buffers[1], sizeof(CUBE_INDICES));
 		glVertexAttribPointer(0, 3, GL_FLOAT, false, 3 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(0);
 
@@ -402,13 +412,60 @@ namespace gfx {
 	void destroyVao(Vao &vao) 
 	{
 		glDeleteVertexArrays(1, &vao.vaoid);
+		mem::untrackBuffers(&vao.buffers[0], vao.buffers.size());
 		glDeleteBuffers(vao.buffers.size(), &vao.buffers[0]);
 		vao.vertcount = 0;
 		vao.buffers.clear();
 	}
 
+	bool debugoutput = false;
+	//With debug output enabled glGetError is still checked every this many
+	//calls to outputErrors in case the driver drops messages
+	constexpr unsigned int ERROR_CHECK_INTERVAL = 300;
+
+	void APIENTRY debugCallback(
+		GLenum /*source*/,
+		GLenum type,
+		GLuint /*id*/,
+		GLenum severity,
+		GLsizei /*length*/,
+		const GLchar *message,
+		const void * /*userparam*/
+	) {
+		if(severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+			return;
+		fprintf(
+			stderr,
+			"OpenGL %s: %s\n",
+			type == GL_DEBUG_TYPE_ERROR ? "error" : "debug message",
+			message
+		);
+	}
+
+	bool enableDebugOutput()
+	{
+		if(!GLAD_GL_VERSION_4_3 || !glad_glDebugMessageCallback)
+			return false;
+		//Messages are optional for contexts that are not debug contexts
+		GLint flags = 0;
+		glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+		if(!(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+			return false;
+		glEnable(GL_DEBUG_OUTPUT);
+		//GL_DEBUG_OUTPUT_SYNCHRONOUS is left off so that the driver does
+		//not have to check for errors after every call
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+		glDebugMessageCallback(debugCallback, nullptr);
+		debugoutput = true;
+		return true;
+	}
+
 	void outputErrors()
 	{
+		static unsigned int calls = 0;
+		calls++;
+		if(debugoutput && calls % ERROR_CHECK_INTERVAL != 0)
+			return;
 		GLenum err = glGetError();
 		int errorcount = 0;
 		while(err != GL_NO_ERROR) {
@@ -457,6 +514,9 @@ namespace gfx {
 				data
 			);	
 			glGenerateMipmap(GL_TEXTURE_2D);
+			//The mipmaps add up to a third of the base level
+			size_t bytes = size_t(width) * size_t(height) * size_t(channels);
+			mem::trackTexture("textures", textureid, bytes + bytes / 3);
 		}
 		else
 			fprintf(stderr, "Failed to open: %s\n", path);
@@ -469,6 +529,7 @@ namespace gfx {
 	{
 		bool success = true;
 		int width, height, channels;
+		size_t bytes = 0;
 		assert(faces.size() == 6); //faces must have 6 elements in it
 		glBindTexture(GL_TEXTURE_CUBE_MAP, textureid);
 
@@ -489,6 +550,7 @@ namespace gfx {
 					GL_UNSIGNED_BYTE, 
 					data
 				);
+				bytes += size_t(width) * size_t(height) * size_t(channels);
 			}
 			else {
 				fprintf(stderr, "Failed to open cubemap file: %s\n", faces.at(i).c_str()); 
@@ -503,31 +565,33 @@ namespace gfx {
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		mem::trackTexture("textures", textureid, bytes);
 
 		return success;
 	}
 
-	float getAngle(float x, float y)
+	//Sign that treats 0 as positive
+	float signNotZero(float v)
 	{
-		if(x == 0.0f && y > 0.0f)
-			return M_PI / 2.0f;
-		if(x == 0.0f && y < 0.0f)
-			return M_PI / 2.0f * 3.0f;
-
-		float angle = atanf(y / x);
-
-		if(x > 0.0f && y < 0.0f)
-			angle += M_PI * 2.0f;
-		else if(x < 0.0f && y > 0.0f)
-			angle += M_PI;
-		else if(x < 0.0f && y < 0.0f)
-			angle += M_PI;
-
-		return angle;
+		return v >= 0.0f ? 1.0f : -1.0f;
 	}
 
 	glm::vec2 compressNormal(glm::vec3 n)
 	{
-		return glm::vec2(getAngle(n.x, n.z), asinf(n.y));
+		//Project onto the octahedron |x| + |y| + |z| = 1 and fold the
+		//lower half (y < 0) over the upper half
+		n /= fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		if(n.y >= 0.0f)
+			return glm::vec2(n.x, n.z);
+		return glm::vec2(
+			(1.0f - fabsf(n.z)) * signNotZero(n.x),
+			(1.0f - fabsf(n.x)) * signNotZero(n.z)
+		);
+	}
+
+	int16_t packSnorm16(float v)
+	{
+		v = std::min(std::max(v, -1.0f), 1.0f);
+		return int16_t(roundf(v * 32767.0f));
 	}
 }
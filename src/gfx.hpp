@@ -1,5 +1,6 @@
 #pragma once
 #include <glad/glad.h>
+#include <stdint.h>
 #include <vector>
 #include <glm/glm.hpp>
 #include <string>
@@ -80,8 +81,14 @@ namespace gfx {
 	Vao createCubeVao();
 	void destroyVao(Vao &vao);
 
-	//Outputs opengl errors
+	//Outputs opengl errors, if debug output is enabled glGetError is only
+	//checked every few hundred calls since it can stall the driver
 	void outputErrors();
+	//Reports errors through a KHR_debug callback instead of glGetError,
+	//the callback is asynchronous so it does not slow down rendering.
+	//Returns false if the context does not support debug output or is
+	//not a debug context
+	bool enableDebugOutput();
 	//Converts channels to image format
 	//(1 = RED, 3 = RGB, 4 = RGBA)
 	GLenum getFormat(int channels); 
@@ -92,9 +99,12 @@ namespace gfx {
 	//If loading a face fails, the function will return false, otherwise true
 	bool loadCubemap(const std::vector<std::string> &faces, unsigned int textureid);
 
-	//Converts a normal vector (x, y, z) to a 2d vector consisting of
-	//angles that represent the vector (we assume the original 3d vector
-	//has magnitude of 1). This can allow for a smaller amount of data to
-	//be used in the mesh and improve performance
+	//Converts a normal vector (x, y, z) to a 2d vector with both components
+	//in [-1, 1] using an octahedral mapping (y is treated as "up" so
+	//normals that point upwards keep the most precision). This can allow
+	//for a smaller amount of data to be used in the mesh and improve
+	//performance, the vertex shader decodes it back into a vector
 	glm::vec2 compressNormal(glm::vec3 n);
+	//Converts a value in [-1, 1] to a 16 bit normalized integer
+	int16_t packSnorm16(float v);
 }
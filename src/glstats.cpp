@@ -0,0 +1,349 @@
+#include "glstats.hpp"
+#include <glad/glad.h>
+#include <vector>
+#include <stdio.h>
+
+namespace glstats {
+	struct Pass {
+		const char *name;
+		//Counters of the frame being drawn
+		Counters frame;
+		//Sum of every frame since the last reset
+		Counters total;
+	};
+
+	bool hooksinstalled = false;
+	//Only the thread that owns the GL context makes GL calls so none of
+	//this needs to be synchronized
+	std::vector<Pass> passes;
+	unsigned int currentpass = 0;
+
+	Counters& counters()
+	{
+		if(passes.empty())
+			passes.push_back({ "other", {}, {} });
+		return passes.at(currentpass).frame;
+	}
+
+	void add(Counters &a, const Counters &b)
+	{
+		a.draws += b.draws;
+		a.statechanges += b.statechanges;
+		a.uniforms += b.uniforms;
+		a.uploadbytes += b.uploadbytes;
+	}
+
+	//Original function pointers loaded by glad
+	PFNGLDRAWARRAYSPROC drawArrays;
+	PFNGLDRAWELEMENTSPROC drawElements;
+	PFNGLDRAWELEMENTSINSTANCEDPROC drawElementsInstanced;
+	PFNGLDRAWELEMENTSBASEVERTEXPROC drawElementsBaseVertex;
+	PFNGLMULTIDRAWELEMENTSBASEVERTEXPROC multiDrawElementsBaseVertex;
+	PFNGLUSEPROGRAMPROC useProgram;
+	PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+	PFNGLBINDBUFFERPROC bindBuffer;
+	PFNGLBINDBUFFERBASEPROC bindBufferBase;
+	PFNGLBINDTEXTUREPROC bindTexture;
+	PFNGLACTIVETEXTUREPROC activeTexture;
+	PFNGLENABLEPROC enable;
+	PFNGLDISABLEPROC disable;
+	PFNGLCULLFACEPROC cullFace;
+	PFNGLUNIFORM1IPROC uniform1i;
+	PFNGLUNIFORM1FPROC uniform1f;
+	PFNGLUNIFORM2FPROC uniform2f;
+	PFNGLUNIFORM3FPROC uniform3f;
+	PFNGLUNIFORM4FPROC uniform4f;
+	PFNGLUNIFORMMATRIX4FVPROC uniformMatrix4fv;
+	PFNGLBUFFERDATAPROC bufferData;
+	PFNGLBUFFERSUBDATAPROC bufferSubData;
+	PFNGLBUFFERSTORAGEPROC bufferStorage;
+	PFNGLTEXIMAGE2DPROC texImage2D;
+
+	void APIENTRY countDrawArrays(GLenum mode, GLint first, GLsizei count)
+	{
+		counters().draws++;
+		drawArrays(mode, first, count);
+	}
+
+	void APIENTRY countDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+	{
+		counters().draws++;
+		drawElements(mode, count, type, indices);
+	}
+
+	void APIENTRY countDrawElementsInstanced(
+		GLenum mode,
+		GLsizei count,
+		GLenum type,
+		const void *indices,
+		GLsizei instancecount
+	) {
+		counters().draws++;
+		drawElementsInstanced(mode, count, type, indices, instancecount);
+	}
+
+	void APIENTRY countDrawElementsBaseVertex(
+		GLenum mode,
+		GLsizei count,
+		GLenum type,
+		const void *indices,
+		GLint basevertex
+	) {
+		counters().draws++;
+		drawElementsBaseVertex(mode, count, type, indices, basevertex);
+	}
+
+	void APIENTRY countMultiDrawElementsBaseVertex(
+		GLenum mode,
+		const GLsizei *count,
+		GLenum type,
+		const void *const *indices,
+		GLsizei drawcount,
+		const GLint *basevertex
+	) {
+		//Counted as a single draw since that is what the cpu pays for
+		counters().draws++;
+		multiDrawElementsBaseVertex(mode, count, type, indices, drawcount, basevertex);
+	}
+
+	void APIENTRY countUseProgram(GLuint program)
+	{
+		counters().statechanges++;
+		useProgram(program);
+	}
+
+	void APIENTRY countBindVertexArray(GLuint array)
+	{
+		counters().statechanges++;
+		bindVertexArray(array);
+	}
+
+	void APIENTRY countBindBuffer(GLenum target, GLuint buffer)
+	{
+		counters().statechanges++;
+		bindBuffer(target, buffer);
+	}
+
+	void APIENTRY countBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+	{
+		counters().statechanges++;
+		bindBufferBase(target, index, buffer);
+	}
+
+	void APIENTRY countBindTexture(GLenum target, GLuint texture)
+	{
+		counters().statechanges++;
+		bindTexture(target, texture);
+	}
+
+	void APIENTRY countActiveTexture(GLenum texture)
+	{
+		counters().statechanges++;
+		activeTexture(texture);
+	}
+
+	void APIENTRY countEnable(GLenum cap)
+	{
+		counters().statechanges++;
+		enable(cap);
+	}
+
+	void APIENTRY countDisable(GLenum cap)
+	{
+		counters().statechanges++;
+		disable(cap);
+	}
+
+	void APIENTRY countCullFace(GLenum mode)
+	{
+		counters().statechanges++;
+		cullFace(mode);
+	}
+
+	void APIENTRY countUniform1i(GLint location, GLint v0)
+	{
+		counters().uniforms++;
+		uniform1i(location, v0);
+	}
+
+	void APIENTRY countUniform1f(GLint location, GLfloat v0)
+	{
+		counters().uniforms++;
+		uniform1f(location, v0);
+	}
+
+	void APIENTRY countUniform2f(GLint location, GLfloat v0, GLfloat v1)
+	{
+		counters().uniforms++;
+		uniform2f(location, v0, v1);
+	}
+
+	void APIENTRY countUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+	{
+		counters().uniforms++;
+		uniform3f(location, v0, v1, v2);
+	}
+
+	void APIENTRY countUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+	{
+		counters().uniforms++;
+		uniform4f(location, v0, v1, v2, v3);
+	}
+
+	void APIENTRY countUniformMatrix4fv(
+		GLint location,
+		GLsizei count,
+		GLboolean transpose,
+		const GLfloat *value
+	) {
+		counters().uniforms++;
+		uniformMatrix4fv(location, count, transpose, value);
+	}
+
+	void APIENTRY countBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+	{
+		if(data)
+			counters().uploadbytes += size;
+		bufferData(target, size, data, usage);
+	}
+
+	void APIENTRY countBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+	{
+		counters().uploadbytes += size;
+		bufferSubData(target, offset, size, data);
+	}
+
+	void APIENTRY countBufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags)
+	{
+		if(data)
+			counters().uploadbytes += size;
+		bufferStorage(target, size, data, flags);
+	}
+
+	void APIENTRY countTexImage2D(
+		GLenum target,
+		GLint level,
+		GLint internalformat,
+		GLsizei width,
+		GLsizei height,
+		GLint border,
+		GLenum format,
+		GLenum type,
+		const void *pixels
+	) {
+		if(pixels) {
+			size_t components = 4;
+			if(format == GL_RED)
+				components = 1;
+			else if(format == GL_RG)
+				components = 2;
+			else if(format == GL_RGB)
+				components = 3;
+			size_t componentsize = type == GL_FLOAT ? 4 : 1;
+			counters().uploadbytes += size_t(width) * size_t(height) * components * componentsize;
+		}
+		texImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+	}
+
+	//Saves glad's pointer in 'original' and points glad at 'wrapper',
+	//functions the driver does not have are left alone
+	template<typename T>
+	void hook(T &gladpointer, T &original, T wrapper)
+	{
+		if(!gladpointer)
+			return;
+		original = gladpointer;
+		gladpointer = wrapper;
+	}
+
+	void install()
+	{
+		if(hooksinstalled)
+			return;
+		hook(glad_glDrawArrays, drawArrays, countDrawArrays);
+		hook(glad_glDrawElements, drawElements, countDrawElements);
+		hook(glad_glDrawElementsInstanced, drawElementsInstanced, countDrawElementsInstanced);
+		hook(glad_glDrawElementsBaseVertex, drawElementsBaseVertex, countDrawElementsBaseVertex);
+		hook(
+			glad_glMultiDrawElementsBaseVertex,
+			multiDrawElementsBaseVertex,
+			countMultiDrawElementsBaseVertex
+		);
+		hook(glad_glUseProgram, useProgram, countUseProgram);
+		hook(glad_glBindVertexArray, bindVertexArray, countBindVertexArray);
+		hook(glad_glBindBuffer, bindBuffer, countBindBuffer);
+		hook(glad_glBindBufferBase, bindBufferBase, countBindBufferBase);
+		hook(glad_glBindTexture, bindTexture, countBindTexture);
+		hook(glad_glActiveTexture, activeTexture, countActiveTexture);
+		hook(glad_glEnable, enable, countEnable);
+		hook(glad_glDisable, disable, countDisable);
+		hook(glad_glCullFace, cullFace, countCullFace);
+		hook(glad_glUniform1i, uniform1i, countUniform1i);
+		hook(glad_glUniform1f, uniform1f, countUniform1f);
+		hook(glad_glUniform2f, uniform2f, countUniform2f);
+		hook(glad_glUniform3f, uniform3f, countUniform3f);
+		hook(glad_glUniform4f, uniform4f, countUniform4f);
+		hook(glad_glUniformMatrix4fv, uniformMatrix4fv, countUniformMatrix4fv);
+		hook(glad_glBufferData, bufferData, countBufferData);
+		hook(glad_glBufferSubData, bufferSubData, countBufferSubData);
+		hook(glad_glBufferStorage, bufferStorage, countBufferStorage);
+		hook(glad_glTexImage2D, texImage2D, countTexImage2D);
+		hooksinstalled = true;
+	}
+
+	bool installed()
+	{
+		return hooksinstalled;
+	}
+
+	void beginPass(const char *pass)
+	{
+		for(unsigned int i = 0; i < passes.size(); i++) {
+			//Names are static so comparing pointers is enough
+			if(passes.at(i).name == pass) {
+				currentpass = i;
+				return;
+			}
+		}
+		passes.push_back({ pass, {}, {} });
+		currentpass = passes.size() - 1;
+	}
+
+	void endFrame()
+	{
+		for(auto &pass : passes) {
+			add(pass.total, pass.frame);
+			pass.frame = Counters();
+		}
+	}
+
+	void printSummary(unsigned int frames)
+	{
+		if(frames == 0 || passes.empty())
+			return;
+		Counters sum;
+		for(const auto &pass : passes)
+			add(sum, pass.total);
+		fprintf(stderr, "  GL calls per frame:\n");
+		auto print = [frames](const char *name, const Counters &c) {
+			fprintf(
+				stderr,
+				"    %-20s draws: %7.1f | state: %7.1f | uniforms: %7.1f | uploaded: %9.1f KB\n",
+				name,
+				double(c.draws) / double(frames),
+				double(c.statechanges) / double(frames),
+				double(c.uniforms) / double(frames),
+				double(c.uploadbytes) / 1024.0 / double(frames)
+			);
+		};
+		for(const auto &pass : passes)
+			print(pass.name, pass.total);
+		print("total", sum);
+	}
+
+	void reset()
+	{
+		for(auto &pass : passes)
+			pass.total = Counters();
+	}
+}
@@ -0,0 +1,39 @@
+/*
+ * Counts the OpenGL calls made every frame: draw calls, state changes,
+ * uniform updates and bytes uploaded to buffers and textures, split up
+ * by render pass.
+ *
+ * The loader does not have hooks of its own so install() swaps glad's
+ * function pointers (glad_glDrawElements, etc.) for wrappers that count
+ * the call and forward it to the driver. It has to be called after glad
+ * is loaded and before any of the counted functions are called, nothing
+ * outside of this module needs to know that the calls are counted.
+ * */
+
+#pragma once
+#include <stddef.h>
+
+namespace glstats {
+	struct Counters {
+		unsigned int draws = 0;
+		//Binds, enables, etc.
+		unsigned int statechanges = 0;
+		unsigned int uniforms = 0;
+		size_t uploadbytes = 0;
+	};
+
+	//Replaces glad's function pointers with counting wrappers
+	void install();
+	bool installed();
+	//Calls from now on are counted under 'pass' (must be a string
+	//literal or otherwise live for the whole program)
+	void beginPass(const char *pass);
+	//Adds the current frame's counters to the totals and starts counting
+	//a new frame
+	void endFrame();
+	//Prints the average counters per frame of every pass since the last
+	//reset, 'frames' is the number of frames they were counted over
+	void printSummary(unsigned int frames);
+	//Clears the totals
+	void reset();
+}
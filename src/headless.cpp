@@ -0,0 +1,106 @@
+#include "headless.hpp"
+#include "infworld.hpp"
+#include <stdio.h>
+#include <chrono>
+
+namespace {
+	//FNV-1a, the hash only needs to change when the generated world does
+	//so that the output of different builds can be compared
+	struct Hash {
+		uint64_t value = 14695981039346656037ull;
+
+		void add(const void *data, size_t sz)
+		{
+			const uint8_t *bytes = (const uint8_t*)data;
+			for(size_t i = 0; i < sz; i++) {
+				value ^= bytes[i];
+				value *= 1099511628211ull;
+			}
+		}
+
+		template<typename T>
+		void add(const T &v)
+		{
+			add(&v, sizeof(T));
+		}
+	};
+
+	double secondsSince(std::chrono::steady_clock::time_point start)
+	{
+		std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+		return duration.count();
+	}
+}
+
+int runHeadless(const Args &args)
+{
+	printf("seed: %d\n", args.seed);
+	printf("range: %u\n", args.range);
+	printf("center: %g, %g\n", args.centerx, args.centerz);
+	printf("workers: %u\n", jobs::WorkerPool::get()->workerCount());
+
+	auto totalstart = std::chrono::steady_clock::now();
+	infworld::worldseed permutations = infworld::makePermutations(args.seed, OCTAVES);
+	Hash hash;
+
+	float sz = CHUNK_SZ;
+	for(unsigned int i = 0; i < MAX_LOD; i++) {
+		//Same number of octaves that a ChunkTable of this size would use
+		unsigned int octaves = infworld::octavesForSpacing(sz * 2.0f / float(PREC));
+		unsigned int count = 0;
+		auto start = std::chrono::steady_clock::now();
+		infworld::buildChunks(
+			args.range,
+			infworld::chunkAt(args.centerx, args.centerz, sz),
+			permutations,
+			HEIGHT,
+			sz,
+			octaves,
+			[&hash, &count](infworld::ChunkData &chunk) {
+				hash.add(chunk.position.x);
+				hash.add(chunk.position.z);
+				hash.add(chunk.chunkmesh.ptr(), chunk.chunkmesh.size());
+				chunk = infworld::ChunkData();
+				count++;
+			}
+		);
+		double time = secondsSince(start);
+		printf(
+			"LOD %u: %u chunks, %u octaves, %f s (%.1f chunks/s)\n",
+			i,
+			count,
+			octaves,
+			time,
+			double(count) / time
+		);
+		sz *= LOD_SCALE;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	infworld::DecorationTable decorations(36, CHUNK_SZ, args.centerx, args.centerz);
+	decorations.genDecorations(permutations);
+	double time = secondsSince(start);
+	size_t decorationcount = 0;
+	for(unsigned int i = 0; i < decorations.count(); i++) {
+		infworld::ChunkPos pos = decorations.getPos(i);
+		hash.add(pos.x);
+		hash.add(pos.z);
+		for(const auto &decoration : decorations.getDecorations(i)) {
+			hash.add(decoration.position.x);
+			hash.add(decoration.position.y);
+			hash.add(decoration.position.z);
+			hash.add(int(decoration.type));
+			decorationcount++;
+		}
+	}
+	printf(
+		"Decorations: %u chunks, %zu decorations, %f s\n",
+		decorations.count(),
+		decorationcount,
+		time
+	);
+
+	printf("Total: %f s\n", secondsSince(totalstart));
+	printf("Hash: %016llx\n", (unsigned long long)hash.value);
+	return 0;
+}
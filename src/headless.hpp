@@ -0,0 +1,13 @@
+/*
+ * Generates the world without creating a window or an OpenGL context so
+ * that world generation can be benchmarked (or checked for changes in its
+ * output) on machines without a gpu.
+ * */
+
+#pragma once
+#include "arg.hpp"
+
+//Generates every level of detail and the decorations around the center
+//for the seed and range in 'args', prints how long each part took along
+//with a hash of everything that was generated. Returns the exit code
+int runHeadless(const Args &args);
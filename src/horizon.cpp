@@ -0,0 +1,252 @@
+#include "horizon.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <math.h>
+
+namespace infworld {
+	const float BIN_SIZE = 4.0f / float(HORIZON_BINS);
+
+	//Pseudo angle of the direction (x, z) in [0, 4), 0 is the +x axis and
+	//1 is the +z axis
+	float pseudoAngle(float x, float z)
+	{
+		float p = x / (std::abs(x) + std::abs(z));
+		return z < 0.0f ? 3.0f + p : 1.0f - p;
+	}
+
+	//Wraps a difference between pseudo angles into [-2, 2]
+	float wrapPseudoAngle(float a)
+	{
+		if(a > 2.0f)
+			return a - 4.0f;
+		if(a < -2.0f)
+			return a + 4.0f;
+		return a;
+	}
+
+	//Wraps bin indices around so that angles outside of [0, 4) end up in
+	//the right bin
+	unsigned int horizonBin(int index)
+	{
+		static_assert((HORIZON_BINS & (HORIZON_BINS - 1)) == 0, "bins should be a power of 2");
+		return unsigned(index) & (HORIZON_BINS - 1);
+	}
+
+	//Footprint of the rectangle centered at (x, z) relative to the camera
+	//with half size (ex, ez)
+	template<typename Footprint>
+	Footprint getFootprint(float x, float z, float ex, float ez)
+	{
+		Footprint footprint;
+		float dx = std::max(std::abs(x) - ex, 0.0f), dz = std::max(std::abs(z) - ez, 0.0f);
+		footprint.near = sqrtf(dx * dx + dz * dz);
+		dx = std::abs(x) + ex;
+		dz = std::abs(z) + ez;
+		footprint.far = sqrtf(dx * dx + dz * dz);
+
+		if(footprint.near <= 0.0f) {
+			//The camera is above it
+			footprint.minangle = 0.0f;
+			footprint.maxangle = 4.0f;
+			return footprint;
+		}
+
+		//The camera is outside of the rectangle so it covers less than
+		//half of the horizon
+		float centerangle = pseudoAngle(x, z);
+		float mindelta = 0.0f, maxdelta = 0.0f;
+		const float cornersx[] = { x - ex, x + ex, x - ex, x + ex };
+		const float cornersz[] = { z - ez, z - ez, z + ez, z + ez };
+		for(unsigned int i = 0; i < 4; i++) {
+			float delta = wrapPseudoAngle(pseudoAngle(cornersx[i], cornersz[i]) - centerangle);
+			mindelta = std::min(mindelta, delta);
+			maxdelta = std::max(maxdelta, delta);
+		}
+		footprint.minangle = centerangle + mindelta;
+		footprint.maxangle = centerangle + maxdelta;
+		return footprint;
+	}
+
+	HorizonCuller::HorizonCuller()
+	{
+		horizon = std::vector<float>(HORIZON_BINS);
+	}
+
+	void HorizonCuller::addCandidates(
+		ChunkTable &table,
+		unsigned int tableindex,
+		const glm::vec3 &camerapos
+	) {
+		const geo::AABBList &bounds = table.slotBounds();
+		for(unsigned int i = 0; i < table.visibleCount(); i++) {
+			unsigned int slot = table.visibleSlot(i);
+			Candidate candidate;
+			candidate.table = tableindex;
+			candidate.index = i;
+			candidate.footprint = getFootprint<Footprint>(
+				bounds.x[slot] - camerapos.x,
+				bounds.z[slot] - camerapos.z,
+				bounds.extentx[slot],
+				bounds.extentz[slot]
+			);
+			candidate.highest = bounds.y[slot] + bounds.extenty[slot];
+			candidates.push_back(candidate);
+		}
+	}
+
+	bool HorizonCuller::fartherThan(const Occluder &a, const Occluder &b)
+	{
+		return a.footprint.far > b.footprint.far;
+	}
+
+	void HorizonCuller::addOccluders(
+		const ChunkTable &table,
+		unsigned int slot,
+		const glm::vec3 &camerapos
+	) {
+		const geo::AABBList &bounds = table.slotBounds();
+		const ChunkHeights &heights = table.slotHeights(slot);
+		float cellsz = bounds.extentx[slot] * 2.0f / float(HEIGHT_CELLS);
+		float
+			startx = bounds.x[slot] - bounds.extentx[slot] + cellsz * 0.5f - camerapos.x,
+			startz = bounds.z[slot] - bounds.extentz[slot] + cellsz * 0.5f - camerapos.z;
+		for(unsigned int i = 0; i < HEIGHT_CELLS; i++) {
+			for(unsigned int j = 0; j < HEIGHT_CELLS; j++) {
+				Occluder occluder;
+				occluder.footprint = getFootprint<Footprint>(
+					startx + float(j) * cellsz,
+					startz + float(i) * cellsz,
+					cellsz * 0.5f,
+					cellsz * 0.5f
+				);
+				if(occluder.footprint.near < HORIZON_MIN_OCCLUDER_DIST)
+					continue;
+				occluder.lowest = heights.celllowest[i * HEIGHT_CELLS + j] * SCALE;
+				//The horizon only gets higher, most cells of distant chunks
+				//are already below it and never need to go on the heap
+				if(!raisesHorizon(occluder, camerapos))
+					continue;
+				pending.push_back(occluder);
+				std::push_heap(pending.begin(), pending.end(), fartherThan);
+			}
+		}
+	}
+
+	//Any line of sight through the cell that is below its lowest point
+	//somewhere in it is blocked, this is the least steep such slope
+	float blockedSlope(float lowest, float near, float far, const glm::vec3 &camerapos)
+	{
+		float h = lowest - camerapos.y;
+		return h / (h > 0.0f ? far : near);
+	}
+
+	bool HorizonCuller::raisesHorizon(const Occluder &occluder, const glm::vec3 &camerapos) const
+	{
+		float slope = blockedSlope(
+			occluder.lowest,
+			occluder.footprint.near,
+			occluder.footprint.far,
+			camerapos
+		);
+		int first = int(ceilf(occluder.footprint.minangle / BIN_SIZE));
+		int last = int(floorf(occluder.footprint.maxangle / BIN_SIZE)) - 1;
+		for(int i = first; i <= last; i++)
+			if(horizon[horizonBin(i)] < slope)
+				return true;
+		return false;
+	}
+
+	void HorizonCuller::commitOccluder(const Occluder &occluder, const glm::vec3 &camerapos)
+	{
+		float slope = blockedSlope(
+			occluder.lowest,
+			occluder.footprint.near,
+			occluder.footprint.far,
+			camerapos
+		);
+		//Only bins that are entirely within the cell's angles, every line
+		//of sight in them passes through the cell
+		int first = int(ceilf(occluder.footprint.minangle / BIN_SIZE));
+		int last = int(floorf(occluder.footprint.maxangle / BIN_SIZE)) - 1;
+		for(int i = first; i <= last; i++) {
+			float &blocked = horizon[horizonBin(i)];
+			blocked = std::max(blocked, slope);
+		}
+	}
+
+	bool HorizonCuller::occluded(const Candidate &candidate, const glm::vec3 &camerapos) const
+	{
+		if(candidate.footprint.near <= 0.0f)
+			return false;
+		//Steepest slope to any point of the chunk
+		float h = candidate.highest - camerapos.y;
+		float slope = h / (h > 0.0f ? candidate.footprint.near : candidate.footprint.far);
+		//Every bin that the chunk touches
+		int first = int(floorf(candidate.footprint.minangle / BIN_SIZE));
+		int last = int(floorf(candidate.footprint.maxangle / BIN_SIZE));
+		for(int i = first; i <= last; i++)
+			if(horizon[horizonBin(i)] <= slope)
+				return false;
+		return true;
+	}
+
+	unsigned int HorizonCuller::cull(
+		ChunkTable *tables,
+		unsigned int count,
+		const glm::vec3 &camerapos
+	) {
+		PROFILE_SCOPE("HorizonCuller::cull");
+		if(count == 0)
+			return 0;
+		//Lines of sight only end up under the terrain after passing
+		//through it if they start above it
+		if(tables[0].highestAt(camerapos.x, camerapos.z) >= camerapos.y)
+			return 0;
+
+		candidates.clear();
+		for(unsigned int i = 0; i < count; i++)
+			addCandidates(tables[i], i, camerapos);
+		std::sort(
+			candidates.begin(),
+			candidates.end(),
+			[](const Candidate &a, const Candidate &b) {
+				return a.footprint.near < b.footprint.near;
+			}
+		);
+
+		std::fill(horizon.begin(), horizon.end(), -INFINITY);
+		hidden.resize(count);
+		for(unsigned int i = 0; i < count; i++)
+			hidden[i].assign(tables[i].visibleCount(), 0);
+		pending.clear();
+
+		unsigned int removed = 0;
+		for(const auto &candidate : candidates) {
+			//Occluders that are entirely in front of this chunk
+			while(!pending.empty() && pending.front().footprint.far <= candidate.footprint.near) {
+				commitOccluder(pending.front(), camerapos);
+				std::pop_heap(pending.begin(), pending.end(), fartherThan);
+				pending.pop_back();
+			}
+
+			if(occluded(candidate, camerapos)) {
+				hidden[candidate.table][candidate.index] = 1;
+				removed++;
+				continue;
+			}
+
+			//Edges of the table can be covered by the next level of
+			//detail instead, so they are not used as occluders
+			ChunkTable &table = tables[candidate.table];
+			unsigned int slot = table.visibleSlot(candidate.index);
+			ChunkPos p = table.getPos(slot), center = table.getCenter();
+			int interior = int(table.range()) - HORIZON_EDGE_CHUNKS;
+			if(std::abs(p.x - center.x) < interior && std::abs(p.z - center.z) < interior)
+				addOccluders(table, slot, camerapos);
+		}
+
+		for(unsigned int i = 0; i < count; i++)
+			tables[i].removeHidden(hidden[i]);
+		return removed;
+	}
+}
@@ -0,0 +1,96 @@
+/*
+ * Occlusion culling for terrain chunks that are hidden behind nearer
+ * terrain (mountains, ridges, etc.), done on the cpu after frustum culling
+ * and before the chunks are drawn so it does not need any gpu queries.
+ *
+ * The chunks that passed frustum culling are visited front to back by
+ * their horizontal distance from the camera. The horizon is split into
+ * bins of azimuth angles around the camera, each bin keeps the steepest
+ * slope (height above the camera / horizontal distance) below which every
+ * line of sight is blocked by terrain that has already been visited.
+ * A chunk is hidden if the slope to its highest point is below the horizon
+ * in every bin that it covers.
+ *
+ * Terrain is a heightfield so the ground under each cell of a chunk (see
+ * ChunkHeights) is solid at least up to the cell's lowest point. Occluders
+ * are cells using their lowest point at their farthest distance and
+ * occludees are chunks using their highest point at their nearest
+ * distance, so a chunk is only hidden if it is certainly behind the
+ * terrain in front of it. An occluder is only added to the horizon once
+ * the chunks being tested are entirely behind it.
+ *
+ * Directions are measured with a "pseudo angle" in [0, 4) that increases
+ * monotonically with the real angle but does not need any trigonometry,
+ * bins cover equal ranges of it.
+ * */
+
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "infworld.hpp"
+
+namespace infworld {
+	//Number of azimuth bins that the horizon is split into (a power of 2)
+	constexpr unsigned int HORIZON_BINS = 1024;
+	//Chunks closer than this are not used as occluders, the terrain that
+	//blocks the view could be in front of the near plane
+	constexpr float HORIZON_MIN_OCCLUDER_DIST = 16.0f;
+	//Chunks within this many chunks of the edge of their table are not used
+	//as occluders since that part of the table is covered by the next level
+	//of detail (the terrain shader discards it, see 'maxrange')
+	constexpr int HORIZON_EDGE_CHUNKS = 4;
+
+	class HorizonCuller {
+		//Part of the terrain as seen from the camera
+		struct Footprint {
+			//Horizontal distance from the camera to the nearest and
+			//farthest point
+			float near, far;
+			//Range of pseudo angles that it covers
+			float minangle, maxangle;
+		};
+
+		struct Candidate {
+			unsigned int table;
+			//Index in the table's visible chunks (see ChunkTable::visibleSlot)
+			unsigned int index;
+			Footprint footprint;
+			float highest;
+		};
+
+		struct Occluder {
+			Footprint footprint;
+			float lowest;
+		};
+		//Heap order of 'pending'
+		static bool fartherThan(const Occluder &a, const Occluder &b);
+
+		//Steepest blocked slope in every bin
+		std::vector<float> horizon;
+		//Reused every frame
+		std::vector<Candidate> candidates;
+		//Occluders that are not in the horizon yet, kept as a heap so that
+		//the nearest one (by far distance) is at the front
+		std::vector<Occluder> pending;
+		std::vector<std::vector<uint8_t>> hidden;
+
+		void addCandidates(ChunkTable &table, unsigned int tableindex, const glm::vec3 &camerapos);
+		//Queues up the cells of the chunk as occluders
+		void addOccluders(const ChunkTable &table, unsigned int slot, const glm::vec3 &camerapos);
+		//True if the occluder is above the horizon in one of the bins that
+		//it completely covers, otherwise committing it would not change
+		//anything
+		bool raisesHorizon(const Occluder &occluder, const glm::vec3 &camerapos) const;
+		//Adds the occluder to every bin that it completely covers
+		void commitOccluder(const Occluder &occluder, const glm::vec3 &camerapos);
+		bool occluded(const Candidate &candidate, const glm::vec3 &camerapos) const;
+	public:
+		HorizonCuller();
+		//Removes the chunks hidden behind nearer terrain from the chunks that
+		//passed the last ChunkTable::cull of every table, returns the number
+		//of chunks removed. Tables are passed in order of detail (most
+		//detailed first) like they are drawn
+		unsigned int cull(ChunkTable *tables, unsigned int count, const glm::vec3 &camerapos);
+	};
+}
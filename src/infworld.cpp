@@ -1,17 +1,43 @@
 #include "infworld.hpp"
+#include "profiler.hpp"
+#include "fbm.hpp"
 #include <random>
 #include <glad/glad.h>
 #include <chrono>
-#include <thread>
+#include <algorithm>
+#include <math.h>
+#include "jobs.hpp"
 
 namespace infworld {
+	size_t worldseed::size() const
+	{
+		return octaves.size();
+	}
+
+	const rng::permutation256& worldseed::operator[](size_t i) const
+	{
+		return octaves[i];
+	}
+
+	const rng::permutation256& worldseed::at(size_t i) const
+	{
+		return octaves.at(i);
+	}
+
 	worldseed makePermutations(int seed, unsigned int count)
 	{
-		worldseed permutations(count);
+		worldseed permutations;
+		permutations.octaves = std::vector<rng::permutation256>(count);
 		std::minstd_rand lcg(seed);
 
 		for(int i = 0; i < count; i++)
-			rng::createPermutation(permutations[i], lcg());
+			rng::createPermutation(permutations.octaves[i], lcg());
+
+		//The vectorized kernels read 4 bytes at a time from the table
+		permutations.interleaved = std::vector<uint8_t>(256 * count + 3);
+		for(unsigned int i = 0; i < 256; i++)
+			for(unsigned int j = 0; j < count; j++)
+				permutations.interleaved[i * count + j] = permutations.octaves[j][i];
 
 		return permutations;
 	}
@@ -26,93 +52,334 @@ namespace infworld {
 		return (x - lowerx) / (upperx - lowerx) * (b - a) + a;
 	}
 
+	//Pieces of the function that remaps the sum of the noise octaves
+	//to give flatter lowlands and steeper mountains
+	struct RemapSegment {
+		float lowerx, upperx, a, b;
+	};
+
+	constexpr RemapSegment REMAP_SEGMENTS[4] = {
+		{ -1.0f, -0.1f, -1.0f, 0.003f },
+		{ -0.1f, 0.0f, 0.003f, 0.03f },
+		{ 0.0f, 0.15f, 0.03f, 0.12f },
+		{ 0.15f, 1.0f, 0.12f, 1.0f },
+	};
+
+	inline const RemapSegment& remapSegment(float height)
+	{
+		//Select the segment without branching
+		unsigned int segment = 
+			unsigned(height >= -0.1f) + 
+			unsigned(height >= 0.0f) + 
+			unsigned(height >= 0.15f);
+		return REMAP_SEGMENTS[segment];
+	}
+
+	float remapHeight(float height)
+	{
+		const RemapSegment &s = remapSegment(height);
+		return interpolate(height, s.lowerx, s.upperx, s.a, s.b);
+	}
+
+	//Derivative of remapHeight
+	float remapSlope(float height)
+	{
+		const RemapSegment &s = remapSegment(height);
+		return (s.b - s.a) / (s.upperx - s.lowerx);
+	}
+
 	float getHeight(float x, float z, const worldseed &permutations) 
 	{
+		if(permutations.size() == OCTAVES)
+			return remapHeight(fbm<OCTAVES>(x, z, &permutations.interleaved[0]));
+
 		float height = 0.0f;
 		float freq = FREQUENCY;
 		float amplitude = 1.0f;
 
-		for(int i = 0; i < permutations.size(); i++) {
+		for(unsigned int i = 0; i < permutations.size(); i++) {
 			float h = perlin::noise(x / freq, z / freq, permutations[i]) * amplitude;
 			height += h;
 			freq /= 2.0f;
 			amplitude /= 2.0f;
 		}
 
-		if(height < -0.1f)
-			height = interpolate(height, -1.0f, -0.1f, -1.0f, 0.003f);
-		else if(height >= -0.1f && height < 0.0f)
-			height = interpolate(height, -0.1f, 0.0f, 0.003f, 0.03f);
-		else if(height >= 0.0f && height < 0.15f)
-			height = interpolate(height, 0.0f, 0.15f, 0.03f, 0.12f);
-		else if(height >= 0.1f)
-			height = interpolate(height, 0.15f, 1.0f, 0.12f, 1.0f);
+		return remapHeight(height); //normalized to be between -1.0 and 1.0
+	}
+
+	void getHeights(
+		const float *x,
+		const float *z,
+		float *heights,
+		unsigned int n,
+		const worldseed &permutations
+	) {
+		std::vector<float> scaledx(n), scaledz(n), octave(n);
+		std::fill(heights, heights + n, 0.0f);
+		float freq = FREQUENCY;
+		float amplitude = 1.0f;
+
+		for(unsigned int i = 0; i < permutations.size(); i++) {
+			for(unsigned int j = 0; j < n; j++) {
+				scaledx[j] = x[j] / freq;
+				scaledz[j] = z[j] / freq;
+			}
+			perlin::noiseBatch(&scaledx[0], &scaledz[0], &octave[0], n, permutations[i]);
+			for(unsigned int j = 0; j < n; j++)
+				heights[j] += octave[j] * amplitude;
+			freq /= 2.0f;
+			amplitude /= 2.0f;
+		}
 
-		return height; //normalized to be between -1.0 and 1.0
+		for(unsigned int j = 0; j < n; j++)
+			heights[j] = remapHeight(heights[j]);
 	}
 
-	glm::vec3 getTerrainVertex(
+	float getHeightAndGradient(
 		float x,
 		float z,
 		const worldseed &permutations,
-		float maxheight
+		float &dx,
+		float &dz
+	) {
+		float height = 0.0f;
+		float freq = FREQUENCY;
+		float amplitude = 1.0f;
+		dx = 0.0f;
+		dz = 0.0f;
+
+		for(unsigned int i = 0; i < permutations.size(); i++) {
+			float ndx, ndz;
+			float n = perlin::noiseWithGradient(x / freq, z / freq, permutations[i], ndx, ndz);
+			height += n * amplitude;
+			//Chain rule, the noise is sampled at (x / freq, z / freq)
+			dx += ndx * (amplitude / freq);
+			dz += ndz * (amplitude / freq);
+			freq /= 2.0f;
+			amplitude /= 2.0f;
+		}
+
+		float slope = remapSlope(height);
+		dx *= slope;
+		dz *= slope;
+		return remapHeight(height);
+	}
+
+	void getHeightsAndGradients(
+		const float *x,
+		const float *z,
+		float *heights,
+		float *dx,
+		float *dz,
+		unsigned int n,
+		const worldseed &permutations,
+		unsigned int octaves
 	) {
-		float h = getHeight(x, z, permutations) * maxheight;
+		octaves = std::min<unsigned int>(octaves, permutations.size());
+		//Sum the octaves of as many points as possible in registers, the
+		//points that are left over (and seeds that the kernels are not
+		//specialized for) go through the loop below which gives exactly
+		//the same results
+		unsigned int done = 0;
+		if(permutations.size() == perlin::FBM_OCTAVES) {
+			done = perlin::fbmGradientBatch(
+				x,
+				z,
+				heights,
+				dx,
+				dz,
+				n,
+				&permutations.interleaved[0],
+				octaves,
+				FREQUENCY
+			);
+		}
+
+		unsigned int remaining = n - done;
+		std::vector<float> scaledx(remaining), scaledz(remaining);
+		std::vector<float> octave(remaining), octavedx(remaining), octavedz(remaining);
+		std::fill(heights + done, heights + n, 0.0f);
+		std::fill(dx + done, dx + n, 0.0f);
+		std::fill(dz + done, dz + n, 0.0f);
+		float freq = FREQUENCY;
+		float amplitude = 1.0f;
+
+		for(unsigned int i = 0; i < octaves && remaining > 0; i++) {
+			for(unsigned int j = 0; j < remaining; j++) {
+				scaledx[j] = x[done + j] / freq;
+				scaledz[j] = z[done + j] / freq;
+			}
+			perlin::noiseGradientBatch(
+				&scaledx[0],
+				&scaledz[0],
+				&octave[0],
+				&octavedx[0],
+				&octavedz[0],
+				remaining,
+				permutations[i]
+			);
+			for(unsigned int j = 0; j < remaining; j++) {
+				heights[done + j] += octave[j] * amplitude;
+				dx[done + j] += octavedx[j] * (amplitude / freq);
+				dz[done + j] += octavedz[j] * (amplitude / freq);
+			}
+			freq /= 2.0f;
+			amplitude /= 2.0f;
+		}
+
+		for(unsigned int j = 0; j < n; j++) {
+			float slope = remapSlope(heights[j]);
+			dx[j] *= slope;
+			dz[j] *= slope;
+			heights[j] = remapHeight(heights[j]);
+		}
+	}
+
+	unsigned int octavesForSpacing(float spacing)
+	{
+		unsigned int octaves = 1;
+		float wavelength = FREQUENCY / 2.0f;
+		while(wavelength >= spacing && octaves < 32) {
+			octaves++;
+			wavelength /= 2.0f;
+		}
+		return octaves;
+	}
+
+	float maxOctaveError(unsigned int octaves, const worldseed &permutations, float maxheight)
+	{
+		//Steepest segment of remapHeight
+		float slope = 0.0f;
+		for(int i = 0; i < 4; i++) {
+			const RemapSegment &s = REMAP_SEGMENTS[i];
+			slope = std::max(slope, (s.b - s.a) / (s.upperx - s.lowerx));
+		}
+
+		//Sum of the amplitudes of the octaves that are skipped
+		float skipped = 0.0f;
+		for(unsigned int i = octaves; i < permutations.size(); i++)
+			skipped += 1.0f / float(1u << i);
+
+		return skipped * slope * maxheight;
+	}
+
+	//Keeps terrain from sitting exactly at sea level
+	float terrainHeight(float height, float maxheight)
+	{
+		float h = height * maxheight;
 		if(h <= 0.0f)
 			h = std::min(-0.007f, h);
 		else if(h >= 0.0f)
 			h = std::max(0.007f, h);
+		return h;
+	}
+
+	glm::vec3 getTerrainVertex(
+		float x,
+		float z,
+		const worldseed &permutations,
+		float maxheight
+	) {
+		float h = terrainHeight(getHeight(x, z, permutations), maxheight);
 		return glm::vec3(x, h, z);
 	}
 
-	mesh::ElementArrayBuffer<float> createChunkElementArray(
+	std::vector<uint16_t> createChunkIndices()
+	{
+		std::vector<uint16_t> indices;
+		indices.reserve(CHUNK_VERT_COUNT);
+		for(unsigned int i = 0; i < PREC; i++) {
+			for(unsigned int j = 0; j < PREC; j++) {
+				unsigned int index = i * (PREC + 1) + j;
+				indices.push_back(index + (PREC + 1));
+				indices.push_back(index + 1);
+				indices.push_back(index);
+
+				indices.push_back(index + 1);
+				indices.push_back(index + (PREC + 1));
+				indices.push_back(index + (PREC + 1) + 1);
+			}
+		}
+		return indices;
+	}
+
+	ChunkMesh createChunkMesh(
 		const worldseed &permutations,
 		int chunkx,
 		int chunkz,
 		float maxheight,
-		float chunkscale
+		float chunkscale,
+		unsigned int octaves,
+		ChunkHeights &chunkheights
 	) {
-		mesh::ElementArrayBuffer<float> worldarraybuffer;
-
-		worldarraybuffer.mesh.vertices.reserve(PREC * PREC * 3 * 2);
-		worldarraybuffer.indices.reserve(CHUNK_VERT_COUNT);
+		ChunkMesh chunkmesh;
+		chunkmesh.vertices.reserve(CHUNK_VERTICES);
 
+		//Sample the height and slope of every vertex in one batch
+		const unsigned int vertcount = CHUNK_VERTICES;
+		std::vector<float> samplex(vertcount), samplez(vertcount);
+		std::vector<float> heights(vertcount), dx(vertcount), dz(vertcount);
 		for(unsigned int i = 0; i <= PREC; i++) {
 			for(unsigned int j = 0; j <= PREC; j++) {
 				float x = -chunkscale + float(i) / float(PREC) * chunkscale * 2.0f;
 				float z = -chunkscale + float(j) / float(PREC) * chunkscale * 2.0f;
 				float tx = x + float(chunkx) * chunkscale * 2.0f;
 				float tz = z + float(chunkz) * chunkscale * 2.0f;
-
-				glm::vec3 vertex = getTerrainVertex(tx, tz, permutations, maxheight);
-
-				glm::vec3
-					v1 = getTerrainVertex(tx + 0.01f, tz, permutations, maxheight),
-					v2 = getTerrainVertex(tx, tz + 0.01f, permutations, maxheight),
-					norm = glm::normalize(glm::cross(v2 - vertex, v1 - vertex));
-				glm::vec2 n = gfx::compressNormal(norm);
-
-				worldarraybuffer.mesh.vertices.push_back(vertex.y / maxheight);	
-				worldarraybuffer.mesh.vertices.push_back(n.x);
-				worldarraybuffer.mesh.vertices.push_back(n.y);
+				unsigned int index = i * (PREC + 1) + j;
+				samplex[index] = tx;
+				samplez[index] = tz;
 			}
 		}
+		getHeightsAndGradients(
+			&samplex[0],
+			&samplez[0],
+			&heights[0],
+			&dx[0],
+			&dz[0],
+			vertcount,
+			permutations,
+			octaves
+		);
 
-		//Indices
-		for(unsigned int i = 0; i < PREC; i++) {
-			for(unsigned int j = 0; j < PREC; j++) {
-				unsigned int index = i * (PREC + 1) + j;
-				worldarraybuffer.indices.push_back(index + (PREC + 1));
-				worldarraybuffer.indices.push_back(index + 1);
-				worldarraybuffer.indices.push_back(index);
+		chunkheights.lowest = INFINITY;
+		chunkheights.highest = -INFINITY;
+		std::fill_n(chunkheights.celllowest, HEIGHT_CELLS * HEIGHT_CELLS, INFINITY);
+		std::fill_n(chunkheights.cellhighest, HEIGHT_CELLS * HEIGHT_CELLS, -INFINITY);
+		for(unsigned int i = 0; i < vertcount; i++) {
+			float h = terrainHeight(heights[i], maxheight);
+			//Terrain that got clamped near sea level is flat
+			float slope = h == heights[i] * maxheight ? maxheight : 0.0f;
+			glm::vec3 norm = glm::normalize(glm::vec3(-dx[i] * slope, 1.0f, -dz[i] * slope));
+			glm::vec2 n = gfx::compressNormal(norm);
+
+			ChunkVertex vertex;
+			vertex.height = gfx::packSnorm16(h / maxheight);
+			vertex.padding = 0;
+			vertex.normal[0] = gfx::packSnorm16(n.x);
+			vertex.normal[1] = gfx::packSnorm16(n.y);
+			chunkmesh.vertices.push_back(vertex);
 
-				worldarraybuffer.indices.push_back(index + 1);
-				worldarraybuffer.indices.push_back(index + (PREC + 1));
-				worldarraybuffer.indices.push_back(index + (PREC + 1) + 1);
+			float decoded = std::max(float(vertex.height) / 32767.0f, -1.0f) * maxheight;
+			chunkheights.lowest = std::min(chunkheights.lowest, decoded);
+			chunkheights.highest = std::max(chunkheights.highest, decoded);
+			//Vertices on the edge between cells belong to both of them
+			const unsigned int cellsz = PREC / HEIGHT_CELLS;
+			unsigned int row = i / (PREC + 1), col = i % (PREC + 1);
+			unsigned int
+				rowend = std::min(row / cellsz, HEIGHT_CELLS - 1),
+				colend = std::min(col / cellsz, HEIGHT_CELLS - 1),
+				rowstart = row % cellsz == 0 && row > 0 ? row / cellsz - 1 : rowend,
+				colstart = col % cellsz == 0 && col > 0 ? col / cellsz - 1 : colend;
+			for(unsigned int cr = rowstart; cr <= rowend; cr++) {
+				for(unsigned int cc = colstart; cc <= colend; cc++) {
+					unsigned int cell = cr * HEIGHT_CELLS + cc;
+					chunkheights.celllowest[cell] = std::min(chunkheights.celllowest[cell], decoded);
+					chunkheights.cellhighest[cell] = std::max(chunkheights.cellhighest[cell], decoded);
+				}
 			}
 		}
 
-		return worldarraybuffer;
+		return chunkmesh;
 	}
 
 	ChunkData buildChunk(
@@ -120,30 +387,59 @@ namespace infworld {
 		int x,
 		int z,
 		float maxheight,
-		float chunkscale
+		float chunkscale,
+		unsigned int octaves
 	) {
-		return {
-			infworld::createChunkElementArray(permutations, x, z, maxheight, chunkscale),
-			{ x, z }
-		};
-	}
-
-	inline unsigned int joinBuilderThreads(
-		std::vector<std::thread> &builders,
-		const std::vector<ChunkData> &builtchunks,
-		ChunkTable &chunks,
-		unsigned int ind,
-		unsigned int maxsz
+		PROFILE_SCOPE_XZ("buildChunk", x, z);
+		ChunkData chunk;
+		chunk.position = { x, z };
+		chunk.chunkmesh = infworld::createChunkMesh(
+			permutations,
+			x,
+			z,
+			maxheight,
+			chunkscale,
+			octaves,
+			chunk.heights
+		);
+		return chunk;
+	}
+
+	void buildChunks(
+		unsigned int range,
+		ChunkPos center,
+		const infworld::worldseed &permutations,
+		float maxheight,
+		float chunkscale,
+		unsigned int octaves,
+		const std::function<void(ChunkData &)> &consume
 	) {
-		if(builders.size() < maxsz)
-			return 0;
-		for(auto &th : builders)
-			th.join();
-		for(int i = 0; i < builders.size(); i++)
-			chunks.addChunk(ind + i, builtchunks.at(i));
-		unsigned int sz = builders.size();
-		builders.clear();
-		return sz;
+		const unsigned int count = (2 * range + 1) * (2 * range + 1);
+		std::vector<ChunkData> builtchunks(count);
+		std::vector<jobs::Counter> built(count);
+
+		//Build the chunks on the worker pool
+		jobs::WorkerPool *pool = jobs::WorkerPool::get();
+		unsigned int ind = 0;
+		for(int x = center.x - int(range); x <= center.x + int(range); x++) {
+			for(int z = center.z - int(range); z <= center.z + int(range); z++) {
+				ChunkData *chunk = &builtchunks[ind];
+				pool->submit(
+					[chunk, &permutations, maxheight, chunkscale, octaves, x, z]() {
+						*chunk = 
+							buildChunk(permutations, x, z, maxheight, chunkscale, octaves);
+					},
+					built[ind]
+				);
+				ind++;
+			}
+		}
+
+		//Hand the chunks over in the order they were submitted
+		for(unsigned int i = 0; i < count; i++) {
+			pool->wait(built[i]);
+			consume(builtchunks[i]);
+		}
 	}
 
 	ChunkTable buildWorld(
@@ -153,36 +449,36 @@ namespace infworld {
 		float chunkscale 
 	) {
 		auto starttime = std::chrono::steady_clock::now();
-		unsigned int threadcount = 
-			std::max<unsigned int>(std::thread::hardware_concurrency(), 4);
-	
-		std::vector<ChunkData> builtchunks(threadcount);
+
 		ChunkTable chunks(range, chunkscale, maxheight);
 		chunks.genBuffers();
-		auto build = 
-			[&builtchunks, &permutations, &maxheight, &chunkscale]
-			(int x, int z, int i) {
-				builtchunks[i] = buildChunk(permutations, x, z, maxheight, chunkscale);
-			};
-		
-		//Multithreading to speed up terrain generation/building
-		std::vector<std::thread> builders; 
-		int ind = 0;
-		for(int x = -int(range); x <= int(range); x++) {
-			for(int z = -int(range); z <= int(range); z++) {
-				builders.push_back(std::thread(build, x, z, builders.size()));
-				unsigned int sz = 	
-					joinBuilderThreads(builders, builtchunks, chunks, ind, threadcount);
-				ind += sz;
-			}
-		}
 
-		joinBuilderThreads(builders, builtchunks, chunks, ind, 0);
+		//Upload chunks as they are built, freeing the mesh data once it
+		//is on the gpu
+		buildChunks(
+			range,
+			ChunkPos(),
+			permutations,
+			maxheight,
+			chunkscale,
+			chunks.octaveCount(),
+			[&chunks](ChunkData &chunk) {
+				ChunkPos pos = chunk.position;
+				chunks.addChunk(chunks.slot(pos.x, pos.z), chunk);
+				chunk = ChunkData();
+			}
+		);
 
 		auto endtime = std::chrono::steady_clock::now();
 		std::chrono::duration<double> duration = endtime - starttime;
 		double time = duration.count();
 		printf("Time to generate world: %f\n", time);
+		printf("Index buffer memory saved: %zu bytes\n", chunks.indexBytesSaved());
+		printf(
+			"Octaves: %u (max height error: %f)\n",
+			std::min<unsigned int>(chunks.octaveCount(), permutations.size()),
+			maxOctaveError(chunks.octaveCount(), permutations, maxheight)
+		);
 	
 		return chunks;
 	}
@@ -4,38 +4,129 @@
 #include <glm/glm.hpp>
 #include <random>
 #include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include "noise.hpp"
 #include "gfx.hpp"
 #include "geometry.hpp"
 #include "shader.hpp"
+#include "jobs.hpp"
 
 constexpr unsigned int PREC = 32;
 constexpr float CHUNK_SZ = 32.0f;
 constexpr float HEIGHT = 270.0f;
 constexpr float SCALE = 2.5f;
 constexpr float FREQUENCY = 720.0f;
-constexpr size_t CHUNK_VERT_SZ = 3;
-constexpr size_t CHUNK_VERT_SZ_BYTES = CHUNK_VERT_SZ * sizeof(float);
+//Number of chunk tables and how much bigger the chunks get in each one
+constexpr unsigned int MAX_LOD = 5;
+constexpr float LOD_SCALE = 2.0f;
+//Number of octaves in the default world seed, getHeight and
+//getHeightsAndGradients have specialized versions for seeds with this
+//many octaves
+constexpr unsigned int OCTAVES = 9;
+static_assert(OCTAVES == perlin::FBM_OCTAVES, "chunks should be built with the fbm kernels");
 constexpr unsigned int CHUNK_VERT_COUNT = PREC * PREC * 6;
-//2 buffers per chunk:
-//0 -> position
-//1 -> normals
-//2 -> indices
-constexpr unsigned int BUFFER_PER_CHUNK = 3;
+//Number of vertices in a chunk's mesh (the indices are the same for every
+//chunk so they are shared)
+constexpr unsigned int CHUNK_VERTICES = (PREC + 1) * (PREC + 1);
+static_assert(CHUNK_VERTICES <= 65536, "chunk indices must fit in 16 bits");
+//Chunks keep the height range of HEIGHT_CELLS x HEIGHT_CELLS cells of
+//their terrain for occlusion culling (see horizon.hpp)
+constexpr unsigned int HEIGHT_CELLS = 4;
+static_assert(PREC % HEIGHT_CELLS == 0, "cells must line up with the vertices");
+//Chunks are culled in blocks of CULL_BLOCK x CULL_BLOCK slots, which are
+//grouped into superblocks of CULL_SUPERBLOCK x CULL_SUPERBLOCK blocks
+constexpr unsigned int CULL_BLOCK = 8;
+constexpr unsigned int CULL_SUPERBLOCK = 4;
 
 namespace infworld {
 	//We will use a seed value (an integer) to generate multiple
 	//pseudorandom permutations to feed into the perlin noise generator
 	//for world generation
-	typedef std::vector<rng::permutation256> worldseed;
+	struct worldseed {
+		//One permutation per octave of noise
+		std::vector<rng::permutation256> octaves;
+		//The same permutations interleaved into one block, entry i of
+		//octave j is at interleaved[i * size() + j] (used by fbm and
+		//perlin::fbmGradientBatch, which needs 3 bytes of padding at the end)
+		std::vector<uint8_t> interleaved;
+
+		size_t size() const;
+		const rng::permutation256& operator[](size_t i) const;
+		const rng::permutation256& at(size_t i) const;
+	};
 
 	struct ChunkPos {
 		int x = 0, z = 0;
 	};
 
+	//Packs a chunk position into a single integer for use as a hash key
+	uint64_t chunkKey(ChunkPos pos);
+	//Chunk that contains the point (x, z) for chunks that are 'chunkscale'
+	//in size (the scale passed to ChunkTable)
+	ChunkPos chunkAt(float x, float z, float chunkscale);
+
+	//Vertex of a chunk, the x and z coordinates are derived from the
+	//vertex id in the shader so only the height and normal are stored
+	struct ChunkVertex {
+		//Height divided by the maximum height, as a 16 bit normalized int
+		int16_t height;
+		//Keeps the normal aligned to 4 bytes
+		int16_t padding;
+		//Octahedral encoded normal (see gfx::compressNormal)
+		int16_t normal[2];
+	};
+	static_assert(sizeof(ChunkVertex) == 8, "chunk vertices should be 8 bytes");
+	typedef mesh::Mesh<ChunkVertex> ChunkMesh;
+
+	//Lowest and highest point of a chunk's terrain (before SCALE is
+	//applied) and of each of its cells, cell (i, j) is at index
+	//i * HEIGHT_CELLS + j where i goes along the z axis and j along the
+	//x axis of the world
+	struct ChunkHeights {
+		float lowest = 0.0f, highest = 0.0f;
+		float celllowest[HEIGHT_CELLS * HEIGHT_CELLS] = {};
+		float cellhighest[HEIGHT_CELLS * HEIGHT_CELLS] = {};
+	};
+
 	struct ChunkData {
-		mesh::ElementArrayBuffer<float> chunkmesh;
+		ChunkMesh chunkmesh;
 		ChunkPos position;
+		ChunkHeights heights;
+	};
+
+	//Chunks built on the worker pool that are waiting to be uploaded,
+	//shared between a ChunkTable and the jobs building its chunks
+	struct BuiltChunkQueue {
+		struct BuiltChunk {
+			unsigned int index;
+			unsigned int version;
+			ChunkData chunk;
+		};
+		std::mutex lock;
+		std::vector<BuiltChunk> chunks;
+		jobs::Counter building;
+		//Chunks that were prefetched before the table was recentered,
+		//they are moved into 'chunks' once their slot needs them
+		std::unordered_map<uint64_t, ChunkData> staged;
+		std::unordered_set<uint64_t> prefetching;
+	};
+
+	//Chunk that is waiting to be submitted to the worker pool, see
+	//submitChunks for how they are prioritized
+	struct ChunkRequest {
+		//Index of the table (level of detail) the chunk belongs to
+		unsigned int lod;
+		ChunkPos pos;
+		//Version of the chunk's slot when it was queued
+		unsigned int version;
+		bool visible;
+		//Squared horizontal distance from the camera
+		float distance;
+		//Chunk is being built ahead of time (see ChunkTable::prefetchChunks)
+		bool prefetch;
 	};
 
 	enum DecorationType {
@@ -48,6 +139,15 @@ namespace infworld {
 		DecorationType type;
 	};
 
+	//Decorations generated ahead of time by DecorationTable::prefetch,
+	//shared between the table and the jobs generating them
+	struct StagedDecorations {
+		std::mutex lock;
+		std::unordered_map<uint64_t, std::vector<Decoration>> chunks;
+		std::unordered_set<uint64_t> prefetching;
+		jobs::Counter pending;
+	};
+
 	class DecorationTable {
 		unsigned int size;
 		int centerx = 0, centerz = 0;
@@ -57,29 +157,56 @@ namespace infworld {
 		std::vector<std::vector<Decoration>> decorations;
 		std::vector<ChunkPos> positions;
 		std::unordered_map<unsigned int, unsigned int> vaoCount;
+		std::shared_ptr<StagedDecorations> staged;
+		//Jobs started by genNewDecorations
+		std::shared_ptr<jobs::Counter> generating;
 
-		void genDecorations(
+		static void genDecorations(
 			const worldseed &permutations,
 			DecorationType type,
 			unsigned int n,
 			int x,
 			int z,
-			unsigned int index,
+			float chunkscale,
+			std::vector<Decoration> &decorations,
 			std::minstd_rand0 &lcg
 		);	
-		void generate(const worldseed &permutations, unsigned int index);
+		static std::vector<Decoration> generate(
+			const worldseed &permutations,
+			ChunkPos pos,
+			float chunkscale
+		);
+		//Chunk that contains the point (x, z)
+		ChunkPos chunkAt(float x, float z) const;
 	public:
 		DecorationTable(unsigned int sz, float scale);
-		//Draw chunk decorations
-		void drawDecorations(const gfx::Vao &vao);
+		//Table that starts out centered on the chunk containing
+		//(camerax, cameraz) instead of the origin
+		DecorationTable(unsigned int sz, float scale, float camerax, float cameraz);
+		//Draw chunk decorations, returns the number of instances drawn
+		unsigned int drawDecorations(const gfx::Vao &vao);
 		//Generate decorations
 		void genDecorations(const worldseed &permutations);
-		//Returns true if new decorations needed to be generated
+		ChunkPos getPos(unsigned int index) const;
+		const std::vector<Decoration>& getDecorations(unsigned int index) const;
+		//Starts generating decorations for the chunks that came into range
+		//on the worker pool, returns true if new decorations need to be
+		//generated. Nothing is started while a previous generation is
+		//still running, the offsets should only be regenerated once
+		//finishedGenerating returns true
 		bool genNewDecorations(
 			float camerax,
 			float cameraz,
 			const worldseed &permutations
 		);
+		bool finishedGenerating() const;
+		//Generates the decorations that would be needed if the camera
+		//were at (predictedx, predictedz) on the worker pool so that
+		//genNewDecorations does not have to wait for them
+		void prefetch(float predictedx, float predictedz, const worldseed &permutations);
+		//Blocks until every chunk that is being generated or prefetched
+		//has been generated
+		void waitForPending();
 		void generateOffsets(
 			DecorationType type,
 			const gfx::Vao &vao,
@@ -87,6 +214,9 @@ namespace infworld {
 			unsigned int maxrange
 		);
 		unsigned int count();
+		//Bytes used by the generated decorations (including prefetched
+		//ones), should only be called when finishedGenerating is true
+		size_t bytes() const;
 	};
 
 	class ChunkTable {
@@ -94,14 +224,75 @@ namespace infworld {
 		unsigned int size;
 		float chunkscale;
 		float height;
-		std::vector<unsigned int> vaoids;
-		std::vector<unsigned int> bufferids; 
+		//Number of octaves of noise sampled for the chunks in this table
+		unsigned int octaves;
+		//Every chunk's vertices live in one buffer, slot i starts at
+		//vertex i * CHUNK_VERTICES so that the whole table can be drawn
+		//with a single glMultiDrawElementsBaseVertex call
+		unsigned int vao = 0;
+		unsigned int vertexbuffer = 0;
+		//(x, z) offset of the chunk in every slot, stored in a texture
+		//buffer that the vertex shader indexes with
+		//gl_VertexID / CHUNK_VERTICES (gl_VertexID includes the base vertex)
+		unsigned int offsetbuffer = 0;
+		unsigned int offsettexture = 0;
+		//Arguments of the multi draw call, every chunk has the same count
+		//and indices so only the base vertices are filled in when drawing
+		std::vector<GLsizei> drawcounts;
+		std::vector<const void*> drawindices;
+		std::vector<GLint> drawbasevertices;
+		//Number of chunks in drawbasevertices that passed the last cull
+		unsigned int visiblecount = 0;
 		std::vector<ChunkPos> chunkpos;
+		//World space bounding box of the chunk in every slot, set by
+		//addChunk so that drawing does not need to compute anything
+		geo::AABBList bounds;
+		std::vector<ChunkHeights> slotheights;
+		//Bounds of every block and superblock of slots (blocks are stored
+		//row by row, blocks per row = blocks), only recomputed when one of
+		//their chunks has changed. A block that contains slots from both
+		//sides of the toroidal wrap is large and just never gets rejected
+		unsigned int blocks = 0, superblocks = 0;
+		geo::AABBList blockbounds, superblockbounds;
+		std::vector<uint8_t> blockdirty, superblockdirty;
 		int centerx = 0, centerz = 0;
 
-		//For generating new chunks
-		std::vector<unsigned int> indices;
-		std::vector<ChunkPos> newChunks;
+		//For generating new chunks:
+		//targetpos is the chunk each slot should contain once all the
+		//pending chunks are built (chunkpos is what is currently uploaded)
+		//and slotversion is bumped every time a slot is given a new target
+		//so that outdated chunks can be thrown away when they finish
+		std::vector<ChunkPos> targetpos;
+		std::vector<unsigned int> slotversion;
+		std::shared_ptr<BuiltChunkQueue> builtchunks;
+		//Chunks that have been queued but not submitted to the worker
+		//pool yet (ChunkRequest::lod and the ranking are filled in later)
+		//along with the version of each slot that was last submitted
+		std::vector<ChunkRequest> queued;
+		std::vector<unsigned int> submittedversion;
+		//Chunks to build ahead of time, see prefetchChunks
+		std::vector<ChunkPos> prefetchqueue;
+		//Name of the table's vertex buffers in the memory ledger
+		std::string memtag;
+
+		//Makes the chunk at (x, z) the target of its slot and queues it
+		//up to be built
+		void queueChunk(int x, int z);
+		//Chunk that contains the point (x, z)
+		ChunkPos chunkAt(float x, float z) const;
+		//Recomputes the bounds of blocks and superblocks that are dirty
+		void updateCullBounds();
+		//Culls the chunks in block (bx, bz) against the planes of the frustum
+		//in 'planemask' and appends the visible ones to the draw arguments
+		//starting at index 'visible', returns the new number of visible chunks
+		unsigned int cullBlock(
+			unsigned int bx,
+			unsigned int bz,
+			unsigned int planemask,
+			unsigned int minrange,
+			const geo::Frustum &viewfrustum,
+			unsigned int visible
+		);
 	public:
 		ChunkTable(unsigned int range, float scale, float h);
 		ChunkTable();
@@ -109,34 +300,144 @@ namespace infworld {
 		void clearBuffers();
 		void addChunk(
 			unsigned int index,
-			const mesh::ElementArrayBuffer<float> &chunkmesh,
+			const ChunkMesh &chunkmesh,
 			int x,
-			int z
+			int z,
+			const ChunkHeights &heights
 		);
 		void addChunk(unsigned int index, const ChunkData &chunk);
-		void bindVao(unsigned int index);
+		//Chunks are stored in a toroidal grid, chunk (x, z) is always in
+		//slot (x mod size, z mod size) so moving the center only replaces
+		//the chunks along the edges and no searching is needed
+		unsigned int slot(int x, int z) const;
+		//Returns true if the chunk at (x, z) is currently uploaded
+		bool hasChunk(int x, int z) const;
 		ChunkPos getPos(unsigned int index);
 		unsigned int count() const;
 		ChunkPos getCenter();
 		void setCenter(int x, int z);
-		void generateNewChunks(
-			float camerax,
-			float cameraz,
-			const worldseed &permutations
-		);
-		//returns the number of chunks drawn
-		unsigned int draw(ShaderProgram &shader, const geo::Frustum &viewfrustum);
-		unsigned int draw(
-			ShaderProgram &shader,
-			unsigned int minrange,
-			const geo::Frustum &viewfrustum
+		//Queues up chunks to be built when the camera moves into a new
+		//chunk (submitChunks hands them to the worker pool), old chunks
+		//remain drawable until they are replaced by uploadChunks
+		void generateNewChunks(float camerax, float cameraz);
+		//Builds the chunks that would be needed if the camera were at
+		//(predictedx, predictedz) ahead of time, they are kept in a
+		//staging area until the table is recentered and are then swapped
+		//in without having to be built. Only the next ring of chunks is
+		//prefetched no matter how far away the predicted position is
+		void prefetchChunks(float predictedx, float predictedz);
+		//Appends the queued chunks that still need to be built to
+		//'requests' ranked for the given camera
+		void getRequests(
+			unsigned int lod,
+			const glm::vec3 &camerapos,
+			const geo::Frustum &viewfrustum,
+			std::vector<ChunkRequest> &requests
 		);
+		//Submits a chunk returned by getRequests to the worker pool
+		void submitChunk(const ChunkRequest &request, const worldseed &permutations);
+		//Number of chunks submitted to the worker pool that are not built
+		unsigned int buildingCount() const;
+		//Number of chunks that are built and waiting to be uploaded
+		unsigned int readyCount() const;
+		//Uploads at most 'maxcount' chunks that have finished building,
+		//returns the number of chunks uploaded
+		unsigned int uploadChunks(unsigned int maxcount);
+		//Number of chunks that are queued or built but not uploaded yet
+		unsigned int pendingCount() const;
+		//Blocks until every chunk submitted to the worker pool is built
+		void waitForPending();
+		//Finds the chunks in the view frustum, skipping chunks within
+		//'minrange' of the center (they are covered by a more detailed
+		//table), returns the number of visible chunks
+		unsigned int cull(unsigned int minrange, const geo::Frustum &viewfrustum);
+		//Draws the chunks that passed the last cull with one draw call using
+		//the shader that is in use, the chunk offsets are bound to texture
+		//unit 1 ('chunkoffsets' in the shader) and are added in the vertex
+		//shader so every table is drawn with the same transform.
+		//Returns the number of chunks drawn
+		unsigned int draw();
+		//Number of chunks that passed the last cull
+		unsigned int visibleCount() const;
+		//Slot of the i-th chunk that passed the last cull
+		unsigned int visibleSlot(unsigned int i) const;
+		//Removes the chunks that passed the last cull but are flagged in
+		//'hidden' (indexed the same way as visibleSlot), returns the new
+		//number of visible chunks
+		unsigned int removeHidden(const std::vector<uint8_t> &hidden);
+		//World space bounding box of the chunk in every slot
+		const geo::AABBList& slotBounds() const;
+		//Height ranges of the chunk in a slot (before SCALE is applied)
+		const ChunkHeights& slotHeights(unsigned int index) const;
+		//Highest point of the terrain near the point (x, z) (world space),
+		//infinity if the chunk that contains it has not been uploaded
+		float highestAt(float x, float z) const;
 		float scale() const;
 		unsigned int range() const;	
+		unsigned int octaveCount() const;
+		//Bytes of gpu memory saved by sharing the index buffer instead
+		//of giving every chunk its own 32 bit copy
+		size_t indexBytesSaved() const;
+		//Bytes of mesh data that has been built but not uploaded yet
+		//(including prefetched chunks)
+		size_t stagingBytes() const;
 	};
 
+	//Submits the queued chunks of 'count' tables (indexed by level of
+	//detail) to the worker pool in order of importance: chunks in the view
+	//frustum first, then the closest chunks, then the most detailed ones.
+	//The order is recomputed every call so turning the camera reorders
+	//the chunks that have not been submitted yet, at most 'maxbuilding'
+	//chunks are built at once so that the order still matters
+	void submitChunks(
+		ChunkTable *tables,
+		unsigned int count,
+		const glm::vec3 &camerapos,
+		const geo::Frustum &viewfrustum,
+		unsigned int maxbuilding,
+		const worldseed &permutations
+	);
 	worldseed makePermutations(int seed, unsigned int count);
 	float getHeight(float x, float z, const worldseed &permutations);
+	//Returns getHeight(x, z) and writes its partial derivatives
+	//with respect to x and z to dx and dz
+	float getHeightAndGradient(
+		float x,
+		float z,
+		const worldseed &permutations,
+		float &dx,
+		float &dz
+	);
+	//getHeight for n points at once, evaluates the noise in batches
+	void getHeights(
+		const float *x,
+		const float *z,
+		float *heights,
+		unsigned int n,
+		const worldseed &permutations
+	);
+	//getHeightAndGradient for n points at once, only the first 'octaves'
+	//octaves of noise are sampled
+	void getHeightsAndGradients(
+		const float *x,
+		const float *z,
+		float *heights,
+		float *dx,
+		float *dz,
+		unsigned int n,
+		const worldseed &permutations,
+		unsigned int octaves
+	);
+	//Number of octaves worth sampling for vertices that are 'spacing'
+	//apart: octaves with a wavelength (FREQUENCY / 2^i) shorter than the
+	//spacing between vertices only add aliasing so they are skipped
+	unsigned int octavesForSpacing(float spacing);
+	//Largest possible difference between the height with all of the
+	//octaves in 'permutations' and the height with only 'octaves' octaves,
+	//each octave of noise is within [-1, 1] so the skipped octaves sum to
+	//less than 2^(1 - octaves) which is then scaled by the steepest part of
+	//the height remap (~1.115) and maxheight
+	float maxOctaveError(unsigned int octaves, const worldseed &permutations, float maxheight);
 	float interpolate(float x, float lowerx, float upperx, float a, float b);
 	glm::vec3 getTerrainVertex(
 		float x,
@@ -144,20 +445,41 @@ namespace infworld {
 		const worldseed &permutations,
 		float maxheight
 	);
-	mesh::ElementArrayBuffer<float> createChunkElementArray(
+	//Triangle indices of a chunk, the same for every chunk
+	std::vector<uint16_t> createChunkIndices();
+	//Vertices of a chunk (the indices come from createChunkIndices),
+	//'heights' is set to the height range of the vertices as the shader
+	//will decode them
+	ChunkMesh createChunkMesh(
 		const worldseed &permutations,
 		int chunkx,
 		int chunkz,
 		float maxheight,
-		float chunkscale
+		float chunkscale,
+		unsigned int octaves,
+		ChunkHeights &heights
 	);
 	ChunkData buildChunk(
 		const infworld::worldseed &permutations,
 		int x,
 		int z,
 		float maxheight,
-		float chunkscale
+		float chunkscale,
+		unsigned int octaves
+	);
+	//Builds every chunk within 'range' of 'center' on the worker pool
+	//without touching the gpu, 'consume' is called on the calling thread
+	//with each chunk (in order) as soon as it is built
+	void buildChunks(
+		unsigned int range,
+		ChunkPos center,
+		const infworld::worldseed &permutations,
+		float maxheight,
+		float chunkscale,
+		unsigned int octaves,
+		const std::function<void(ChunkData &)> &consume
 	);
+	//Builds the chunks with buildChunks and uploads them to a new table
 	ChunkTable buildWorld(
 		unsigned int range,
 		const infworld::worldseed &permutations,
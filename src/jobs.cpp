@@ -0,0 +1,187 @@
+#include "jobs.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+
+namespace jobs {
+	//Index of the deque owned by the current thread, -1 if the thread
+	//is not one of the pool's workers
+	thread_local int workerindex = -1;
+
+	Counter::Counter()
+	{
+		remaining = 0;
+	}
+
+	void Counter::add(unsigned int count)
+	{
+		remaining += count;
+	}
+
+	void Counter::done()
+	{
+		remaining--;
+	}
+
+	bool Counter::finished() const
+	{
+		return remaining == 0;
+	}
+
+	unsigned int Counter::count() const
+	{
+		return remaining;
+	}
+
+	WorkerPool::WorkerPool(unsigned int count)
+	{
+		queued = 0;
+		stopping = false;
+		for(unsigned int i = 0; i <= count; i++)
+			queues.push_back(std::make_unique<JobQueue>());
+		for(unsigned int i = 0; i < count; i++)
+			workers.push_back(std::thread(&WorkerPool::workerLoop, this, i));
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(sleeplock);
+			stopping = true;
+		}
+		wakeup.notify_all();
+		for(auto &worker : workers)
+			worker.join();
+	}
+
+	WorkerPool* WorkerPool::get()
+	{
+		//Leave one hardware thread for the render thread, it helps out
+		//with jobs whenever it has to wait on them anyway
+		unsigned int hwthreads = std::thread::hardware_concurrency();
+		if(hwthreads == 0)
+			hwthreads = 4;
+		static WorkerPool pool(std::max<unsigned int>(hwthreads - 1, 1));
+		return &pool;
+	}
+
+	WorkerPool::JobQueue& WorkerPool::sharedQueue()
+	{
+		return *queues.back();
+	}
+
+	void WorkerPool::push(const Job &job)
+	{
+		{
+			std::lock_guard<std::mutex> guard(sleeplock);
+			queued++;
+		}
+
+		if(workerindex >= 0) {
+			JobQueue &queue = *queues.at(workerindex);
+			std::lock_guard<std::mutex> guard(queue.lock);
+			queue.jobs.push_back(job);
+		}
+		else {
+			JobQueue &queue = sharedQueue();
+			std::lock_guard<std::mutex> guard(queue.lock);
+			queue.jobs.push_back(job);
+		}
+
+		wakeup.notify_one();
+	}
+
+	bool WorkerPool::take(unsigned int index, Job &job)
+	{
+		const unsigned int shared = queues.size() - 1;
+
+		//Newest job from our own deque
+		if(index != shared) {
+			JobQueue &queue = *queues.at(index);
+			std::lock_guard<std::mutex> guard(queue.lock);
+			if(!queue.jobs.empty()) {
+				job = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+				queued--;
+				return true;
+			}
+		}
+
+		//Oldest job from the shared queue, followed by the oldest job
+		//of every other worker
+		for(unsigned int i = 0; i < queues.size(); i++) {
+			unsigned int victim = (shared + i) % queues.size();
+			if(victim == index && index != shared)
+				continue;
+			JobQueue &queue = *queues.at(victim);
+			std::lock_guard<std::mutex> guard(queue.lock);
+			if(queue.jobs.empty())
+				continue;
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			queued--;
+			return true;
+		}
+
+		return false;
+	}
+
+	void WorkerPool::workerLoop(unsigned int index)
+	{
+		workerindex = index;
+		prof::nameThread("worker " + std::to_string(index));
+		Job job;
+		while(true) {
+			if(take(index, job)) {
+				job();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> guard(sleeplock);
+			wakeup.wait(guard, [this]() { return queued > 0 || stopping; });
+			if(stopping)
+				return;
+		}
+	}
+
+	void WorkerPool::submit(const Job &job)
+	{
+		push(job);
+	}
+
+	void WorkerPool::submit(const Job &job, Counter &counter)
+	{
+		counter.add(1);
+		Counter *c = &counter;
+		push([job, c]() {
+			job();
+			c->done();
+		});
+	}
+
+	bool WorkerPool::runOne()
+	{
+		unsigned int index = workerindex >= 0 ? workerindex : queues.size() - 1;
+		Job job;
+		if(!take(index, job))
+			return false;
+		job();
+		return true;
+	}
+
+	void WorkerPool::wait(const Counter &counter)
+	{
+		while(!counter.finished())
+			if(!runOne())
+				std::this_thread::yield();
+	}
+
+	unsigned int WorkerPool::workerCount() const
+	{
+		return workers.size();
+	}
+
+	unsigned int WorkerPool::queuedCount() const
+	{
+		return queued;
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * Process wide pool of worker threads that world generation submits its
+ * work to (chunk building, decoration generation, etc.)
+ *
+ * Every worker owns a deque of jobs: it pops jobs from the back of its own
+ * deque and when that runs dry it steals from the front of the other
+ * workers' deques. Jobs submitted from outside the pool go into a shared
+ * queue that is served in the order the jobs were submitted.
+ * */
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobs {
+	typedef std::function<void()> Job;
+
+	//Keeps track of how many jobs in a group have not finished yet,
+	//can be waited on with WorkerPool::wait
+	class Counter {
+		std::atomic<unsigned int> remaining;
+	public:
+		Counter();
+		void add(unsigned int count);
+		void done();
+		bool finished() const;
+		//Number of jobs that have not finished yet
+		unsigned int count() const;
+	};
+
+	class WorkerPool {
+		struct JobQueue {
+			std::mutex lock;
+			std::deque<Job> jobs;
+		};
+
+		//One deque per worker, the last queue is the shared queue for
+		//jobs that are submitted from outside of the pool
+		std::vector<std::unique_ptr<JobQueue>> queues;
+		std::vector<std::thread> workers;
+		std::mutex sleeplock;
+		std::condition_variable wakeup;
+		std::atomic<unsigned int> queued;
+		bool stopping;
+
+		WorkerPool(unsigned int count);
+		JobQueue& sharedQueue();
+		void push(const Job &job);
+		//Attempts to find a job, 'index' is the queue owned by the caller
+		//(or the shared queue if the caller is not a worker)
+		bool take(unsigned int index, Job &job);
+		void workerLoop(unsigned int index);
+	public:
+		~WorkerPool();
+		static WorkerPool* get();
+		void submit(const Job &job);
+		//Submits a job and adds it to 'counter', the counter is notified
+		//once the job finishes
+		void submit(const Job &job, Counter &counter);
+		//Runs a single queued job on the calling thread,
+		//returns false if there was nothing to run
+		bool runOne();
+		//Blocks until every job in 'counter' has finished, the calling
+		//thread helps out by running queued jobs while it waits
+		void wait(const Counter &counter);
+		unsigned int workerCount() const;
+		//Number of jobs that have been submitted but not started
+		unsigned int queuedCount() const;
+	};
+}
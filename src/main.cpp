@@ -11,15 +11,30 @@
 #include "shader.hpp"
 #include "camera.hpp"
 #include "infworld.hpp"
+#include "worldscheduler.hpp"
 #include "gfx.hpp"
 #include "app.hpp"
 #include "arg.hpp"
 #include "plants.hpp"
+#include "headless.hpp"
+#include "benchmark.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "flightrecorder.hpp"
+#include "memledger.hpp"
+#include "glstats.hpp"
+#include "horizon.hpp"
 
 constexpr float SPEED = 32.0f;
 constexpr float FLY_SPEED = 20.0f;
-constexpr unsigned int MAX_LOD = 5;
-constexpr float LOD_SCALE = 2.0f;
+//Maximum number of chunks being built per worker thread, the rest wait
+//so that they can be reprioritized as the camera moves
+constexpr unsigned int MAX_CHUNKS_PER_WORKER = 2;
+//How many seconds ahead to predict the camera's position when prefetching
+//chunks that are about to come into range
+constexpr float PREFETCH_TIME = 1.5f;
+//Seconds between keyframes when recording a camera path
+constexpr float RECORD_INTERVAL = 0.5f;
 
 void generateChunks(
 	const infworld::worldseed &permutations,
@@ -37,33 +52,54 @@ void generateChunks(
 int main(int argc, char *argv[])
 {
 	Args argvals = parseArgs(argc, argv);
+	if(argvals.headless)
+		return runHeadless(argvals);
 
 	State* state = State::get();
 	Camera& cam = state->getCamera();
 
+	bench::CameraPath benchmarkpath;
+	if(argvals.benchmark && !benchmarkpath.load(argvals.benchmark))
+		die("Failed to load benchmark path!");
+	bench::PathRecorder recorder(argvals.record, RECORD_INTERVAL);
+	if(argvals.record && !recorder.isOpen())
+		die("Failed to open file to record path!");
+	bench::FrameLog framelog;
+	prof::nameThread("main");
+	prof::setTraceOutput(argvals.trace);
+
 	printf("seed: %d\n", argvals.seed);
-	infworld::worldseed permutations = infworld::makePermutations(argvals.seed, 9);
+	infworld::worldseed permutations = infworld::makePermutations(argvals.seed, OCTAVES);
 
 	//Initialize glfw and glad, if any of this fails, kill the program
 	if(!glfwInit()) 
 		die("Failed to init glfw!");
+	//Drivers are only required to send debug messages to a debug context
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
 	GLFWwindow* window = glfwCreateWindow(960, 720, "infworld", NULL, NULL);
 	if(!window)
 		die("Failed to create window!");
 	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1);
+	//Don't wait for vsync when benchmarking so that frame times are measured
+	glfwSwapInterval(argvals.benchmark ? 0 : 1);
 	glfwSetWindowSizeCallback(window, handleWindowResize);
 	glfwSetKeyCallback(window, handleKeyInput);
 	glfwSetCursorPosCallback(window, cursorPosCallback);
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 		die("Failed to init glad!");
+	if(argvals.glstats)
+		glstats::install();
+	if(!gfx::enableDebugOutput())
+		fprintf(stderr, "Debug output not available, checking glGetError every frame\n");
 	initMousePos(window);
 
 	infworld::ChunkTable chunktables[MAX_LOD];	
 	generateChunks(permutations, chunktables, argvals.range);
+	infworld::HorizonCuller horizonculler;
 	infworld::DecorationTable decorations = infworld::DecorationTable(36, CHUNK_SZ);
 	decorations.genDecorations(permutations);
+	mem::set("decorations", decorations.bytes());
 	//Quad
 	gfx::Vao quad = gfx::createQuadVao();
 	//Cube
@@ -104,23 +140,63 @@ int main(int argc, char *argv[])
 	ShaderProgram simpleWaterShader("assets/shaders/instancedvert.glsl", "assets/shaders/watersimplefrag.glsl");
 	ShaderProgram skyboxShader("assets/shaders/skyboxvert.glsl", "assets/shaders/skyboxfrag.glsl");
 	ShaderProgram treeShader("assets/shaders/tree-vert.glsl", "assets/shaders/textured-frag.glsl");
+	unsigned int frameconstantsbuffer = createFrameConstantsBuffer();
+	//Uniforms that do not change between frames
+	const int waterrange = 4;
+	const float quadscale = CHUNK_SZ * 32.0f * SCALE;
 	float viewdist = CHUNK_SZ * SCALE * 2.0f * float(argvals.range) * std::pow(LOD_SCALE, MAX_LOD - 2);
 	waterShader.use();
 	waterShader.uniformFloat("viewdist", viewdist);
+	waterShader.uniformInt("range", waterrange);
+	waterShader.uniformFloat("scale", quadscale);
+	waterShader.uniformInt("waternormals", 0);
+	waterShader.uniformInt("waterdudv", 1);
 	simpleWaterShader.use();
 	simpleWaterShader.uniformFloat("viewdist", viewdist);
 	treeShader.use();
 	treeShader.uniformFloat("viewdist", viewdist);
+	treeShader.uniformFloat("windstrength", SCALE * 3.0f);
+	treeShader.uniformMat4x4("transform", glm::scale(glm::mat4(1.0f), glm::vec3(SCALE * 2.5f)));
+	skyboxShader.use();
+	skyboxShader.uniformInt("skybox", 0);
 	terrainShader.use();
 	terrainShader.uniformFloat("viewdist", viewdist);
 	terrainShader.uniformFloat("maxheight", HEIGHT); 
 	terrainShader.uniformInt("prec", PREC);
+	terrainShader.uniformInt("terraintexture", 0);
+	terrainShader.uniformInt("chunkoffsets", 1);
+	terrainShader.uniformMat4x4("transform", glm::scale(glm::mat4(1.0f), glm::vec3(SCALE)));
+	//Uniforms that are set every frame
+	Uniform<float> terrainchunksz = terrainShader.getUniform<float>("chunksz");
+	Uniform<float> terrainmaxrange = terrainShader.getUniform<float>("maxrange");
+	Uniform<glm::vec2> terraincenter = terrainShader.getUniform<glm::vec2>("center");
+	Uniform<glm::mat4> watertransform = waterShader.getUniform<glm::mat4>("transform");
 	
 	decorations.generateOffsets(infworld::PINE_TREE, pinetree, 0, 5);
 	decorations.generateOffsets(infworld::PINE_TREE, pinetreelowdetail, 5, 999);
 	decorations.generateOffsets(infworld::TREE, tree, 0, 5);
 	decorations.generateOffsets(infworld::TREE, treelowdetail, 5, 16);
 
+	infworld::WorldScheduler scheduler(
+		chunktables,
+		MAX_LOD,
+		&decorations,
+		argvals.budget,
+		jobs::WorkerPool::get()->workerCount() * MAX_CHUNKS_PER_WORKER
+	);
+	scheduler.onDecorationsGenerated([&]() {
+		decorations.generateOffsets(infworld::PINE_TREE, pinetree, 0, 5);
+	});
+	scheduler.onDecorationsGenerated([&]() {
+		decorations.generateOffsets(infworld::PINE_TREE, pinetreelowdetail, 5, 999);
+	});
+	scheduler.onDecorationsGenerated([&]() {
+		decorations.generateOffsets(infworld::TREE, tree, 0, 5);
+	});
+	scheduler.onDecorationsGenerated([&]() {
+		decorations.generateOffsets(infworld::TREE, treelowdetail, 5, 16);
+	});
+
 	glClearColor(0.5f, 0.8f, 1.0f, 1.0f);
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
@@ -130,8 +206,20 @@ int main(int argc, char *argv[])
 	float dt = 0.0f;
 	float time = 0.0f;
 	unsigned int chunksPerSecond = 0; //Number of chunks drawn per second
+	//Smoothed velocity of the camera measured from its recent positions
+	glm::vec3 cameravelocity = glm::vec3(0.0f);
+	if(argvals.tracestart)
+		prof::startTrace();
+	if(argvals.hitchms > 0.0f)
+		prof::startFlightRecorder(argvals.hitchms, "hitch-");
 	while(!glfwWindowShouldClose(window)) {
+		PROFILE_SCOPE("frame");
 		float start = glfwGetTime();
+		if(argvals.benchmark) {
+			if(time >= benchmarkpath.duration())
+				break;
+			benchmarkpath.apply(cam, time);
+		}
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		//Get perspective matrix
@@ -144,147 +232,183 @@ int main(int argc, char *argv[])
 		glm::mat4 view = cam.viewMatrix();
 		geo::Frustum viewfrustum = cam.getViewFrustum(2.0f, 20000.0f, aspect, fovy);	
 
+		FrameConstants frameconstants = {
+			.persp = persp,
+			.view = view,
+			.lightdir = glm::normalize(glm::vec3(-1.0f)),
+			.time = time,
+			.camerapos = cam.position,
+			.padding = 0.0f
+		};
+		updateFrameConstants(frameconstantsbuffer, frameconstants);
+
 		//Draw terrain
-		terrainShader.use();
-		//Textures
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, terraintextures);
-		terrainShader.uniformInt("terraintexture", 0);
-		//uniforms
-		terrainShader.uniformMat4x4("persp", persp);
-		terrainShader.uniformMat4x4("view", view);
-		terrainShader.uniformVec3("lightdir", glm::normalize(glm::vec3(-1.0f)));
-		terrainShader.uniformVec3("camerapos", cam.position);
-		terrainShader.uniformFloat("time", time);
-		unsigned int drawCount = 0;	
+		unsigned int drawCount = 0;
+		{
+			PROFILE_SCOPE("draw terrain");
+			glstats::beginPass("terrain");
+			terrainShader.use();
+			//Textures
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, terraintextures);
+
+			//Every table is culled before any are drawn so that chunks
+			//behind nearer terrain of any level of detail can be skipped
+			for(int i = 0; i < MAX_LOD; i++) {
+				int minrange = i == 0 ? 0 : chunktables[i - 1].range() / int(LOD_SCALE);
+				chunktables[i].cull(minrange, viewfrustum);
+			}
+			if(argvals.occlusion)
+				horizonculler.cull(chunktables, MAX_LOD, cam.position);
 
-		for(int i = 0; i < MAX_LOD; i++) {
-			terrainShader.uniformFloat("chunksz", chunktables[i].scale());
+			for(int i = 0; i < MAX_LOD; i++) {
+				terrainShader.set(terrainchunksz, chunktables[i].scale());
 
-			if(i < MAX_LOD - 1) {
-				float chunkscale = 
-					chunktables[i + 1].scale() * 
-					2.0f * 
-					float(PREC) / float(PREC + 1);
-				float range = float(chunktables[i + 1].range()) / LOD_SCALE - 0.5f;
-				//Slight amount of overlap to mitigate cracks in terrain
-				//We increase this amount due to the terrain becoming less precise
-				//and more likely to have cracks
-				float d = 8.0f * float(i) + 4.0f;
-				float maxrange = chunkscale * range * SCALE + d;
-				infworld::ChunkPos center = chunktables[i + 1].getCenter();
+				if(i < MAX_LOD - 1) {
+					float chunkscale = 
+						chunktables[i + 1].scale() * 
+						2.0f * 
+						float(PREC) / float(PREC + 1);
+					float range = float(chunktables[i + 1].range()) / LOD_SCALE - 0.5f;
+					//Slight amount of overlap to mitigate cracks in terrain
+					//We increase this amount due to the terrain becoming less precise
+					//and more likely to have cracks
+					float d = 8.0f * float(i) + 4.0f;
+					float maxrange = chunkscale * range * SCALE + d;
+					infworld::ChunkPos center = chunktables[i + 1].getCenter();
 				
-				glm::vec2 centerpos = glm::vec2(float(center.z), float(center.x));
-				centerpos *= float(PREC) / float(PREC + 1);
-				centerpos *= chunktables[i + 1].scale() * SCALE * 2.0f;
+					glm::vec2 centerpos = glm::vec2(float(center.z), float(center.x));
+					centerpos *= float(PREC) / float(PREC + 1);
+					centerpos *= chunktables[i + 1].scale() * SCALE * 2.0f;
 				
-				terrainShader.uniformFloat("maxrange", maxrange);
-				terrainShader.uniformVec2("center", centerpos);
-			}
-			else {
-				terrainShader.uniformVec2("center", glm::vec2(0.0f));
-				terrainShader.uniformFloat("maxrange", -1.0f);
-			}
+					terrainShader.set(terrainmaxrange, maxrange);
+					terrainShader.set(terraincenter, centerpos);
+				}
+				else {
+					terrainShader.set(terraincenter, glm::vec2(0.0f));
+					terrainShader.set(terrainmaxrange, -1.0f);
+				}
 
-			if(i == 0)
-				drawCount += chunktables[i].draw(terrainShader, viewfrustum);
-			else {
-				int minrange = chunktables[i - 1].range() / int(LOD_SCALE);
-				drawCount += chunktables[i].draw(terrainShader, minrange, viewfrustum);
+				drawCount += chunktables[i].draw();
 			}
 		}
 		chunksPerSecond += drawCount;
 
 		glDisable(GL_CULL_FACE);
 		//Display trees	
-		treeShader.use();
-		treeShader.uniformMat4x4("persp", persp);
-		treeShader.uniformMat4x4("view", view);
-		treeShader.uniformVec3("lightdir", glm::normalize(glm::vec3(-1.0f)));
-		treeShader.uniformVec3("camerapos", cam.position);
-		treeShader.uniformFloat("time", time);
-		treeShader.uniformFloat("windstrength", SCALE * 3.0f);
-		treeShader.uniformMat4x4(
-			"transform",
-			glm::scale(glm::mat4(1.0f), glm::vec3(SCALE * 2.5f))
-		);
-		treeShader.uniformVec3("camerapos", cam.position);
-		//Draw pine trees
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, pinetexture);
-		pinetree.bind();
-		decorations.drawDecorations(pinetree);
-		pinetreelowdetail.bind();
-		decorations.drawDecorations(pinetreelowdetail);
-		//Draw trees
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, treetexture);
-		tree.bind();
-		decorations.drawDecorations(tree);
-		treelowdetail.bind();
-		decorations.drawDecorations(treelowdetail);
+		unsigned int instanceCount = 0;
+		{
+			PROFILE_SCOPE("draw trees");
+			glstats::beginPass("trees");
+			treeShader.use();
+			//Draw pine trees
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, pinetexture);
+			pinetree.bind();
+			instanceCount += decorations.drawDecorations(pinetree);
+			pinetreelowdetail.bind();
+			instanceCount += decorations.drawDecorations(pinetreelowdetail);
+			//Draw trees
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, treetexture);
+			tree.bind();
+			instanceCount += decorations.drawDecorations(tree);
+			treelowdetail.bind();
+			instanceCount += decorations.drawDecorations(treelowdetail);
+		}
 
-		quad.bind();
-		const int waterrange = 4;
-		const int count = (waterrange * 2 + 1) * (waterrange * 2 + 1);
-		const float quadscale = CHUNK_SZ * 32.0f * SCALE;
 		//Draw water
-		waterShader.use();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, watermaps);
-		waterShader.uniformInt("range", waterrange);
-		waterShader.uniformFloat("scale", quadscale);
-		waterShader.uniformInt("waternormals", 0);
-		waterShader.uniformInt("waterdudv", 1);
-		waterShader.uniformMat4x4("persp", persp);
-		waterShader.uniformMat4x4("view", view);
-		waterShader.uniformVec3("lightdir", glm::normalize(glm::vec3(-1.0f)));
-		waterShader.uniformVec3("camerapos", cam.position);
-		waterShader.uniformFloat("time", time);
-		glm::mat4 transform = glm::mat4(1.0f);
-		transform = glm::translate(transform, glm::vec3(cam.position.x, 0.0f, cam.position.z));
-		transform = glm::scale(transform, glm::vec3(quadscale));
-		waterShader.uniformMat4x4("transform", transform);
-		glDrawElementsInstanced(GL_TRIANGLES, quad.vertcount, GL_UNSIGNED_INT, 0, count);
+		{
+			PROFILE_SCOPE("draw water");
+			glstats::beginPass("water");
+			quad.bind();
+			const int count = (waterrange * 2 + 1) * (waterrange * 2 + 1);
+			waterShader.use();
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, watermaps);
+			glm::mat4 transform = glm::mat4(1.0f);
+			transform = glm::translate(transform, glm::vec3(cam.position.x, 0.0f, cam.position.z));
+			transform = glm::scale(transform, glm::vec3(quadscale));
+			waterShader.set(watertransform, transform);
+			glDrawElementsInstanced(GL_TRIANGLES, quad.vertcount, GL_UNSIGNED_INT, 0, count);
+			instanceCount += count;
+		}
 		glEnable(GL_CULL_FACE);
 
 		//Draw skybox
-		glCullFace(GL_FRONT);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxcubemap);
-		skyboxShader.use();
-		skyboxShader.uniformInt("skybox", 0);
-		skyboxShader.uniformMat4x4("persp", persp);
-		glm::mat4 skyboxView = glm::mat4(glm::mat3(view));
-		skyboxShader.uniformMat4x4("view", skyboxView);
-		cube.bind();
-		glDrawElements(GL_TRIANGLES, cube.vertcount, GL_UNSIGNED_INT, 0);
-		glCullFace(GL_BACK);
+		{
+			PROFILE_SCOPE("draw skybox");
+			glstats::beginPass("skybox");
+			glCullFace(GL_FRONT);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxcubemap);
+			skyboxShader.use();
+			cube.bind();
+			glDrawElements(GL_TRIANGLES, cube.vertcount, GL_UNSIGNED_INT, 0);
+			glCullFace(GL_BACK);
+		}
 
 		//Update camera
-		cam.position += cam.velocity() * dt * SPEED;
-		cam.fly(dt, FLY_SPEED);
-		for(int i = 0; i < MAX_LOD; i++)
-			chunktables[i].generateNewChunks(cam.position.x, cam.position.z, permutations);
-		bool generated = decorations.genNewDecorations(cam.position.x, cam.position.z, permutations);
-		if(generated) {
-			decorations.generateOffsets(infworld::PINE_TREE, pinetree, 0, 5);
-			decorations.generateOffsets(infworld::PINE_TREE, pinetreelowdetail, 5, 999);
-			decorations.generateOffsets(infworld::TREE, tree, 0, 5);
-			decorations.generateOffsets(infworld::TREE, treelowdetail, 5, 16);
+		glm::vec3 prevposition = cam.position;
+		if(!argvals.benchmark) {
+			cam.position += cam.velocity() * dt * SPEED;
+			cam.fly(dt, FLY_SPEED);
+		}
+		recorder.record(cam, time);
+		if(dt > 0.0f) {
+			glm::vec3 measured = (cam.position - prevposition) * (1.0f / dt);
+			cameravelocity = cameravelocity * 0.8f + measured * 0.2f;
+		}
+		glm::vec3 predicted = cam.position + cameravelocity * PREFETCH_TIME;
+		glstats::beginPass("world update");
+		unsigned int generated =
+			scheduler.update(cam.position, predicted, viewfrustum, permutations);
+
+		if(argvals.benchmark) {
+			bench::FrameSample sample = {
+				.cputime = (float(glfwGetTime()) - start) * 1000.0f,
+				.chunksgenerated = generated,
+				.chunksdrawn = drawCount,
+				.instancesdrawn = instanceCount
+			};
+			framelog.add(sample);
 		}
 
-		glfwSwapBuffers(window);
-		gfx::outputErrors();
+		{
+			PROFILE_SCOPE("swap buffers");
+			glstats::beginPass("other");
+			glfwSwapBuffers(window);
+			gfx::outputErrors();
+		}
 		glfwPollEvents();
 		time += dt;
-		outputFps(dt, chunksPerSecond);
+		glstats::endFrame();
+		outputFps(dt, chunksPerSecond, scheduler.backlog());
 		dt = glfwGetTime() - start;
+		prof::endFrame(dt * 1000.0f);
+		if(argvals.fixeddt > 0.0f)
+			dt = argvals.fixeddt;
+	}
+
+	if(argvals.benchmark) {
+		framelog.print();
+		if(!framelog.write(argvals.benchmarkout))
+			fprintf(stderr, "Failed to write benchmark results to %s\n", argvals.benchmarkout);
 	}
 
+	if(prof::tracing()) {
+		prof::collect();
+		prof::stopTrace(argvals.trace);
+	}
+
+	mem::report();
+
 	//Clean up	
-	for(int i = 0; i < MAX_LOD; i++)
+	decorations.waitForPending();
+	for(int i = 0; i < MAX_LOD; i++) {
+		chunktables[i].waitForPending();
 		chunktables[i].clearBuffers();
+	}
 	gfx::destroyVao(quad);
 	glfwTerminate();
 }
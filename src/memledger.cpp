@@ -0,0 +1,114 @@
+#include "memledger.hpp"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <stdio.h>
+
+namespace mem {
+	struct Entry {
+		size_t current = 0, peak = 0;
+	};
+
+	struct GLObject {
+		std::string tag;
+		size_t bytes;
+	};
+
+	std::mutex ledgerlock;
+	//Sorted so that reports always list the tags in the same order
+	std::map<std::string, Entry> entries;
+	std::map<unsigned int, GLObject> trackedbuffers;
+	std::map<unsigned int, GLObject> trackedtextures;
+	size_t peaktotal = 0;
+
+	size_t sumEntries()
+	{
+		size_t sum = 0;
+		for(const auto &entry : entries)
+			sum += entry.second.current;
+		return sum;
+	}
+
+	void adjust(const std::string &tag, size_t removed, size_t added)
+	{
+		Entry &entry = entries[tag];
+		entry.current = entry.current - removed + added;
+		entry.peak = std::max(entry.peak, entry.current);
+		peaktotal = std::max(peaktotal, sumEntries());
+	}
+
+	void trackObject(
+		std::map<unsigned int, GLObject> &objects,
+		const std::string &tag,
+		unsigned int id,
+		size_t bytes
+	) {
+		auto object = objects.find(id);
+		if(object != objects.end()) {
+			adjust(object->second.tag, object->second.bytes, 0);
+			objects.erase(object);
+		}
+		adjust(tag, 0, bytes);
+		objects.insert({ id, { tag, bytes } });
+	}
+
+	void trackBuffer(const std::string &tag, unsigned int buffer, size_t bytes)
+	{
+		std::lock_guard<std::mutex> guard(ledgerlock);
+		trackObject(trackedbuffers, tag, buffer, bytes);
+	}
+
+	void untrackBuffers(const unsigned int *buffers, size_t count)
+	{
+		std::lock_guard<std::mutex> guard(ledgerlock);
+		for(size_t i = 0; i < count; i++) {
+			auto object = trackedbuffers.find(buffers[i]);
+			if(object == trackedbuffers.end())
+				continue;
+			adjust(object->second.tag, object->second.bytes, 0);
+			trackedbuffers.erase(object);
+		}
+	}
+
+	void trackTexture(const std::string &tag, unsigned int texture, size_t bytes)
+	{
+		std::lock_guard<std::mutex> guard(ledgerlock);
+		trackObject(trackedtextures, tag, texture, bytes);
+	}
+
+	void set(const std::string &tag, size_t bytes)
+	{
+		std::lock_guard<std::mutex> guard(ledgerlock);
+		adjust(tag, entries[tag].current, bytes);
+	}
+
+	size_t total()
+	{
+		std::lock_guard<std::mutex> guard(ledgerlock);
+		return sumEntries();
+	}
+
+	void report()
+	{
+		std::lock_guard<std::mutex> guard(ledgerlock);
+		const double MB = 1024.0 * 1024.0;
+		fprintf(stderr, "Memory usage (current / peak):\n");
+		for(const auto &entry : entries) {
+			fprintf(
+				stderr,
+				"  %-40s %9.2f MB / %9.2f MB\n",
+				entry.first.c_str(),
+				double(entry.second.current) / MB,
+				double(entry.second.peak) / MB
+			);
+		}
+		fprintf(
+			stderr,
+			"  %-40s %9.2f MB / %9.2f MB\n",
+			"total",
+			double(sumEntries()) / MB,
+			double(peaktotal) / MB
+		);
+	}
+}
@@ -0,0 +1,30 @@
+/*
+ * Ledger of how much memory every subsystem is using, both on the gpu
+ * (buffers and textures) and on the cpu (large containers).
+ *
+ * Gpu objects are tracked per object so uploading new data to a buffer
+ * replaces its old size instead of adding to it. Cpu containers that
+ * change size all over the place (on worker threads, etc.) are measured
+ * by their owner and set as a total instead.
+ *
+ * Every tag keeps its current total and the highest total it has reached.
+ * */
+
+#pragma once
+#include <stddef.h>
+#include <string>
+
+namespace mem {
+	//Records that 'buffer' now holds 'bytes' bytes of data for 'tag'
+	void trackBuffer(const std::string &tag, unsigned int buffer, size_t bytes);
+	//Forgets buffers that are about to be deleted
+	void untrackBuffers(const unsigned int *buffers, size_t count);
+	//Records that 'texture' now holds 'bytes' bytes of data for 'tag'
+	void trackTexture(const std::string &tag, unsigned int texture, size_t bytes);
+	//Sets the total for a tag that is measured instead of tracked
+	void set(const std::string &tag, size_t bytes);
+	//Current total of every tag combined
+	size_t total();
+	//Prints the current and peak total of every tag to stderr
+	void report();
+}
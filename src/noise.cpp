@@ -1,4 +1,5 @@
 #include "noise.hpp"
+#include "noisekernel.hpp"
 #include <glm/glm.hpp>
 #include <math.h>
 #include <random>
@@ -83,6 +84,76 @@ namespace perlin {
 		return interpolate(lerpedlower, lerpedupper, y - lowery);
 	}
 
+	float fade(float t)
+	{
+		return (3.0f - 2.0f * t) * t * t;
+	}
+
+	float fadeDerivative(float t)
+	{
+		return 6.0f * t * (1.0f - t);
+	}
+
+	//Derivative of interpolate(a, b, t), s is the fade value of t and ds is
+	//its derivative (0 if t does not depend on the variable)
+	float lerpDerivative(float a, float b, float da, float db, float s, float ds)
+	{
+		return da + (db - da) * s + (b - a) * ds;
+	}
+
+	float noiseWithGradient(
+		float x,
+		float y,
+		const rng::permutation256 &p,
+		float &dx,
+		float &dy
+	) {
+		int
+			leftx = int(floorf(x)),
+			lowery = int(floorf(y)),
+			rightx = leftx + 1,
+			uppery = lowery + 1;
+		glm::vec2
+			gradlowerleft = gradient(leftx, lowery, p),
+			gradlowerright = gradient(rightx, lowery, p),
+			gradupperleft = gradient(leftx, uppery, p),
+			gradupperright = gradient(rightx, uppery, p);
+		float
+			lowerleft = glm::dot(gradlowerleft, glm::vec2(x - float(leftx), y - float(lowery))),
+			lowerright = glm::dot(gradlowerright, glm::vec2(x - float(rightx), y - float(lowery))),
+			upperleft = glm::dot(gradupperleft, glm::vec2(x - float(leftx), y - float(uppery))),
+			upperright = glm::dot(gradupperright, glm::vec2(x - float(rightx), y - float(uppery)));
+		float
+			tx = x - leftx,
+			ty = y - lowery;
+		float 
+			lerpedlower = interpolate(lowerleft, lowerright, tx),
+			lerpedupper = interpolate(upperleft, upperright, tx);
+
+		float
+			sx = fade(tx),
+			sy = fade(ty),
+			dsx = fadeDerivative(tx),
+			dsy = fadeDerivative(ty);
+		float
+			lowerdx = lerpDerivative(
+				lowerleft, lowerright, gradlowerleft.x, gradlowerright.x, sx, dsx
+			),
+			lowerdy = lerpDerivative(
+				lowerleft, lowerright, gradlowerleft.y, gradlowerright.y, sx, 0.0f
+			),
+			upperdx = lerpDerivative(
+				upperleft, upperright, gradupperleft.x, gradupperright.x, sx, dsx
+			),
+			upperdy = lerpDerivative(
+				upperleft, upperright, gradupperleft.y, gradupperright.y, sx, 0.0f
+			);
+		dx = lerpDerivative(lerpedlower, lerpedupper, lowerdx, upperdx, sy, 0.0f);
+		dy = lerpDerivative(lerpedlower, lerpedupper, lowerdy, upperdy, sy, dsy);
+
+		return interpolate(lerpedlower, lerpedupper, ty);
+	}
+
 	float noise(float x, float y, int repeat, const rng::permutation256 &p)
 	{
 		int
@@ -100,4 +171,125 @@ namespace perlin {
 			lerpedupper = interpolate(upperleft, upperright, x - leftx);
 		return interpolate(lerpedlower, lerpedupper, y - lowery);
 	}
+
+	enum SimdLevel {
+		SCALAR,
+		SSE2,
+		AVX2,
+		AVX512,
+	};
+
+	SimdLevel getSimdLevel()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f"))
+			return AVX512;
+		if(__builtin_cpu_supports("avx2"))
+			return AVX2;
+		if(__builtin_cpu_supports("sse2"))
+			return SSE2;
+#endif
+		return SCALAR;
+	}
+
+	SimdLevel simdLevel()
+	{
+		static const SimdLevel level = getSimdLevel();
+		return level;
+	}
+
+	const char* simdName()
+	{
+		switch(simdLevel()) {
+		case AVX512:
+			return "AVX-512";
+		case AVX2:
+			return "AVX2";
+		case SSE2:
+			return "SSE2";
+		default:
+			return "scalar";
+		}
+	}
+
+	void noiseBatch(
+		const float *x,
+		const float *y,
+		float *out,
+		unsigned int n,
+		const rng::permutation256 &p
+	) {
+		//Each kernel handles as many points as fit in its vector width,
+		//the remaining points fall through to the narrower kernels
+		unsigned int i = 0;
+		SimdLevel level = simdLevel();
+		if(level >= AVX512)
+			i += simd::noiseAvx512(x + i, y + i, out + i, n - i, p);
+		if(level >= AVX2)
+			i += simd::noiseAvx2(x + i, y + i, out + i, n - i, p);
+		if(level >= SSE2)
+			i += simd::noiseSse2(x + i, y + i, out + i, n - i, p);
+		for(; i < n; i++)
+			out[i] = noise(x[i], y[i], p);
+	}
+
+	void noiseGradientBatch(
+		const float *x,
+		const float *y,
+		float *out,
+		float *dx,
+		float *dy,
+		unsigned int n,
+		const rng::permutation256 &p
+	) {
+		unsigned int i = 0;
+		SimdLevel level = simdLevel();
+		if(level >= AVX512)
+			i += simd::noiseGradientAvx512(x + i, y + i, out + i, dx + i, dy + i, n - i, p);
+		if(level >= AVX2)
+			i += simd::noiseGradientAvx2(x + i, y + i, out + i, dx + i, dy + i, n - i, p);
+		if(level >= SSE2)
+			i += simd::noiseGradientSse2(x + i, y + i, out + i, dx + i, dy + i, n - i, p);
+		for(; i < n; i++)
+			out[i] = noiseWithGradient(x[i], y[i], p, dx[i], dy[i]);
+	}
+
+	unsigned int fbmGradientBatch(
+		const float *x,
+		const float *y,
+		float *out,
+		float *dx,
+		float *dy,
+		unsigned int n,
+		const uint8_t *table,
+		unsigned int octaves,
+		float frequency
+	) {
+		//No scalar fallback, the caller sums the remaining points one
+		//octave at a time
+		unsigned int i = 0;
+		SimdLevel level = simdLevel();
+		if(level >= AVX512) {
+			i += simd::fbmGradientAvx512(
+				x + i, y + i, out + i, dx + i, dy + i, n - i, table, octaves, frequency
+			);
+		}
+		if(level >= AVX2) {
+			i += simd::fbmGradientAvx2(
+				x + i, y + i, out + i, dx + i, dy + i, n - i, table, octaves, frequency
+			);
+		}
+		if(level >= SSE2) {
+			i += simd::fbmGradientSse2(
+				x + i, y + i, out + i, dx + i, dy + i, n - i, table, octaves, frequency
+			);
+		}
+		return i;
+	}
+
+	void noise8(const float *x, const float *y, float *out, const rng::permutation256 &p)
+	{
+		noiseBatch(x, y, out, 8, p);
+	}
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdint.h>
 
 namespace rng {	
 	//Array that represents a random permutation of 0 -> 255
@@ -11,4 +12,58 @@ namespace perlin {
 	float interpolate(float a, float b, float x);
 	float noise(float x, float y, const rng::permutation256 &p);
 	float noise(float x, float y, int repeat, const rng::permutation256 &p);	
+	//Returns the same value as noise(x, y, p) and writes the partial
+	//derivatives of the noise with respect to x and y to dx and dy
+	float noiseWithGradient(
+		float x,
+		float y,
+		const rng::permutation256 &p,
+		float &dx,
+		float &dy
+	);
+	//Evaluates noise(x[i], y[i], p) for n points and writes the results to
+	//out, uses the widest vector instructions the cpu supports and gives
+	//exactly the same results as calling noise on each point
+	void noiseBatch(
+		const float *x,
+		const float *y,
+		float *out,
+		unsigned int n,
+		const rng::permutation256 &p
+	);
+	//noiseWithGradient for n points, same rules as noiseBatch
+	void noiseGradientBatch(
+		const float *x,
+		const float *y,
+		float *out,
+		float *dx,
+		float *dy,
+		unsigned int n,
+		const rng::permutation256 &p
+	);
+	//Number of octaves in the seeds that fbmGradientBatch has kernels for
+	constexpr unsigned int FBM_OCTAVES = 9;
+	//Sums the first 'octaves' octaves of noiseWithGradient for n points,
+	//octave i is sampled at (x / freq, y / freq) where
+	//freq = frequency / 2^i and is scaled by 1 / 2^i. 'table' holds the
+	//permutations of FBM_OCTAVES octaves interleaved (entry j of octave i is
+	//at table[j * FBM_OCTAVES + i]) followed by 3 bytes of padding. The
+	//octave loop is unrolled for every octave count, returns the number of
+	//points that were evaluated (a multiple of the vector width, 0 if there
+	//is no kernel for this cpu) and the caller handles the rest
+	unsigned int fbmGradientBatch(
+		const float *x,
+		const float *y,
+		float *out,
+		float *dx,
+		float *dy,
+		unsigned int n,
+		const uint8_t *table,
+		unsigned int octaves,
+		float frequency
+	);
+	//noiseBatch for 8 points
+	void noise8(const float *x, const float *y, float *out, const rng::permutation256 &p);
+	//Name of the instruction set used by noiseBatch
+	const char* simdName();
 }
@@ -0,0 +1,149 @@
+#include "noisekernel.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace {
+	struct Avx2 {
+		static const unsigned int WIDTH = 8;
+		typedef __m256 F;
+		typedef __m256i I;
+
+		static F load(const float *p) { return _mm256_loadu_ps(p); }
+		static void store(float *p, F v) { _mm256_storeu_ps(p, v); }
+		static F add(F a, F b) { return _mm256_add_ps(a, b); }
+		static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+		static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+		static F div(F a, F b) { return _mm256_div_ps(a, b); }
+		static F toFloat(I v) { return _mm256_cvtepi32_ps(v); }
+		static F constant(float v) { return _mm256_set1_ps(v); }
+		static I floor(F v) { return _mm256_cvttps_epi32(_mm256_floor_ps(v)); }
+
+		static I set(int v) { return _mm256_set1_epi32(v); }
+		static I add(I a, I b) { return _mm256_add_epi32(a, b); }
+		static I mul(I v, unsigned int m) { return _mm256_mullo_epi32(v, _mm256_set1_epi32(m)); }
+		static I bitxor(I a, I b) { return _mm256_xor_si256(a, b); }
+		static I mask(I v, int m) { return _mm256_and_si256(v, _mm256_set1_epi32(m)); }
+		static I rotl16(I v) { return _mm256_or_si256(_mm256_slli_epi32(v, 16), _mm256_srli_epi32(v, 16)); }
+		static I shiftLeft(I v, int n) { return _mm256_slli_epi32(v, n); }
+		static I gather(const int *p, I index) { return _mm256_i32gather_epi32(p, index, 4); }
+
+		//Same as gather but reads the bytes at p[offset], gathers 4 bytes at
+		//a time and keeps the lowest one (the table is padded so this does
+		//not read past its end)
+		static I gatherByte(const uint8_t *p, I offset)
+		{
+			return mask(_mm256_i32gather_epi32((const int*)p, offset, 1), 255);
+		}
+
+		static F lookup4(I index, float v0, float v1, float v2, float v3)
+		{
+			return _mm256_permutevar_ps(_mm256_setr_ps(v0, v1, v2, v3, v0, v1, v2, v3), index);
+		}
+
+		static __m256d interpolate(__m256d a, __m256d ba, __m256d t)
+		{
+			__m256d s = _mm256_sub_pd(_mm256_set1_pd(3.0), _mm256_mul_pd(t, _mm256_set1_pd(2.0)));
+			return _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(ba, s), t), t), a);
+		}
+
+		//(b - a) * (3.0 - t * 2.0) * t * t + a, evaluated in double
+		//precision like perlin::interpolate
+		static F interpolate(F a, F b, F t)
+		{
+			F ba = _mm256_sub_ps(b, a);
+			__m256d
+				lo = interpolate(
+					_mm256_cvtps_pd(_mm256_castps256_ps128(a)),
+					_mm256_cvtps_pd(_mm256_castps256_ps128(ba)),
+					_mm256_cvtps_pd(_mm256_castps256_ps128(t))
+				),
+				hi = interpolate(
+					_mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)),
+					_mm256_cvtps_pd(_mm256_extractf128_ps(ba, 1)),
+					_mm256_cvtps_pd(_mm256_extractf128_ps(t, 1))
+				);
+			return _mm256_insertf128_ps(
+				_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)),
+				_mm256_cvtpd_ps(hi),
+				1
+			);
+		}
+	};
+}
+
+namespace perlin {
+	namespace simd {
+		unsigned int noiseAvx2(
+			const float *x,
+			const float *y,
+			float *out,
+			unsigned int n,
+			const int *p
+		) {
+			return noiseBatch<Avx2>(x, y, out, n, p);
+		}
+
+		unsigned int noiseGradientAvx2(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const int *p
+		) {
+			return noiseGradientBatch<Avx2>(x, y, out, dx, dy, n, p);
+		}
+
+		unsigned int fbmGradientAvx2(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const uint8_t *table,
+			unsigned int octaves,
+			float frequency
+		) {
+			return fbmGradientDispatch<Avx2>(x, y, out, dx, dy, n, table, octaves, frequency);
+		}
+	}
+}
+#else
+namespace perlin {
+	namespace simd {
+		unsigned int noiseAvx2(const float*, const float*, float*, unsigned int, const int*)
+		{
+			return 0;
+		}
+
+		unsigned int noiseGradientAvx2(
+			const float*,
+			const float*,
+			float*,
+			float*,
+			float*,
+			unsigned int,
+			const int*
+		) {
+			return 0;
+		}
+
+		unsigned int fbmGradientAvx2(
+			const float*,
+			const float*,
+			float*,
+			float*,
+			float*,
+			unsigned int,
+			const uint8_t*,
+			unsigned int,
+			float
+		) {
+			return 0;
+		}
+	}
+}
+#endif
@@ -0,0 +1,159 @@
+#include "noisekernel.hpp"
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+
+namespace {
+	struct Avx512 {
+		static const unsigned int WIDTH = 16;
+		typedef __m512 F;
+		typedef __m512i I;
+
+		static F load(const float *p) { return _mm512_loadu_ps(p); }
+		static void store(float *p, F v) { _mm512_storeu_ps(p, v); }
+		static F add(F a, F b) { return _mm512_add_ps(a, b); }
+		static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+		static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+		static F div(F a, F b) { return _mm512_div_ps(a, b); }
+		static F toFloat(I v) { return _mm512_cvtepi32_ps(v); }
+		static F constant(float v) { return _mm512_set1_ps(v); }
+
+		static I floor(F v)
+		{
+			return _mm512_cvttps_epi32(_mm512_roundscale_ps(v, _MM_FROUND_TO_NEG_INF));
+		}
+
+		static I set(int v) { return _mm512_set1_epi32(v); }
+		static I add(I a, I b) { return _mm512_add_epi32(a, b); }
+		static I mul(I v, unsigned int m) { return _mm512_mullo_epi32(v, _mm512_set1_epi32(m)); }
+		static I bitxor(I a, I b) { return _mm512_xor_si512(a, b); }
+		static I mask(I v, int m) { return _mm512_and_si512(v, _mm512_set1_epi32(m)); }
+		static I rotl16(I v) { return _mm512_rol_epi32(v, 16); }
+		static I shiftLeft(I v, int n) { return _mm512_slli_epi32(v, n); }
+		static I gather(const int *p, I index) { return _mm512_i32gather_epi32(index, p, 4); }
+
+		//Same as gather but reads the bytes at p[offset], gathers 4 bytes at
+		//a time and keeps the lowest one (the table is padded so this does
+		//not read past its end)
+		static I gatherByte(const uint8_t *p, I offset)
+		{
+			return mask(_mm512_i32gather_epi32(offset, p, 1), 255);
+		}
+
+		static F lookup4(I index, float v0, float v1, float v2, float v3)
+		{
+			return _mm512_permutexvar_ps(index, _mm512_setr4_ps(v0, v1, v2, v3));
+		}
+
+		static __m512d interpolate(__m512d a, __m512d ba, __m512d t)
+		{
+			__m512d s = _mm512_sub_pd(_mm512_set1_pd(3.0), _mm512_mul_pd(t, _mm512_set1_pd(2.0)));
+			return _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(ba, s), t), t), a);
+		}
+
+		static __m256 upperHalf(F v)
+		{
+			return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+		}
+
+		//(b - a) * (3.0 - t * 2.0) * t * t + a, evaluated in double
+		//precision like perlin::interpolate
+		static F interpolate(F a, F b, F t)
+		{
+			F ba = _mm512_sub_ps(b, a);
+			__m512d
+				lo = interpolate(
+					_mm512_cvtps_pd(_mm512_castps512_ps256(a)),
+					_mm512_cvtps_pd(_mm512_castps512_ps256(ba)),
+					_mm512_cvtps_pd(_mm512_castps512_ps256(t))
+				),
+				hi = interpolate(
+					_mm512_cvtps_pd(upperHalf(a)),
+					_mm512_cvtps_pd(upperHalf(ba)),
+					_mm512_cvtps_pd(upperHalf(t))
+				);
+			__m512d joined = _mm512_insertf64x4(
+				_mm512_castpd256_pd512(_mm256_castps_pd(_mm512_cvtpd_ps(lo))),
+				_mm256_castps_pd(_mm512_cvtpd_ps(hi)),
+				1
+			);
+			return _mm512_castpd_ps(joined);
+		}
+	};
+}
+
+namespace perlin {
+	namespace simd {
+		unsigned int noiseAvx512(
+			const float *x,
+			const float *y,
+			float *out,
+			unsigned int n,
+			const int *p
+		) {
+			return noiseBatch<Avx512>(x, y, out, n, p);
+		}
+
+		unsigned int noiseGradientAvx512(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const int *p
+		) {
+			return noiseGradientBatch<Avx512>(x, y, out, dx, dy, n, p);
+		}
+
+		unsigned int fbmGradientAvx512(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const uint8_t *table,
+			unsigned int octaves,
+			float frequency
+		) {
+			return fbmGradientDispatch<Avx512>(x, y, out, dx, dy, n, table, octaves, frequency);
+		}
+	}
+}
+#else
+namespace perlin {
+	namespace simd {
+		unsigned int noiseAvx512(const float*, const float*, float*, unsigned int, const int*)
+		{
+			return 0;
+		}
+
+		unsigned int noiseGradientAvx512(
+			const float*,
+			const float*,
+			float*,
+			float*,
+			float*,
+			unsigned int,
+			const int*
+		) {
+			return 0;
+		}
+
+		unsigned int fbmGradientAvx512(
+			const float*,
+			const float*,
+			float*,
+			float*,
+			float*,
+			unsigned int,
+			const uint8_t*,
+			unsigned int,
+			float
+		) {
+			return 0;
+		}
+	}
+}
+#endif
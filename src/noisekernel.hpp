@@ -0,0 +1,474 @@
+/*
+ * Vectorized versions of perlin::noise, each instruction set gets its own
+ * translation unit (noisesse2.cpp, noiseavx2.cpp, noiseavx512.cpp) that is
+ * compiled with the flags for that instruction set and noise.cpp picks
+ * which one to call at runtime.
+ *
+ * The kernels must give exactly the same results as perlin::noise, so they
+ * follow it operation for operation (including doing the interpolation in
+ * double precision like the scalar version does).
+ *
+ * fbmGradientBatch sums the octaves of the terrain height in registers with
+ * the octave loop unrolled, reading every octave's permutation from one
+ * interleaved byte table (see perlin::fbmGradientBatch). It has to give
+ * the same sums as the loop in infworld::getHeightsAndGradients.
+ *
+ * Each translation unit defines a struct of operations for its vector type
+ * and instantiates the kernels below with it. noise.cpp also includes this
+ * header, but only for the declarations of the entry points it dispatches
+ * to. Nothing else should include it.
+ * */
+
+#pragma once
+#include <stdint.h>
+#include <utility>
+#include "noise.hpp"
+
+namespace perlin {
+	namespace simd {
+		//Each of these evaluate noise for as many points as they can
+		//(a multiple of the vector width) and return the number of points
+		//they evaluated, the caller handles the rest
+		unsigned int noiseSse2(
+			const float *x,
+			const float *y,
+			float *out,
+			unsigned int n,
+			const int *p
+		);
+		unsigned int noiseAvx2(
+			const float *x,
+			const float *y,
+			float *out,
+			unsigned int n,
+			const int *p
+		);
+		unsigned int noiseAvx512(
+			const float *x,
+			const float *y,
+			float *out,
+			unsigned int n,
+			const int *p
+		);
+
+		//Same as above but also write the partial derivatives of the
+		//noise with respect to x and y (see perlin::noiseWithGradient)
+		unsigned int noiseGradientSse2(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const int *p
+		);
+		unsigned int noiseGradientAvx2(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const int *p
+		);
+		unsigned int noiseGradientAvx512(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const int *p
+		);
+
+		//Same as above but sum the octaves like perlin::fbmGradientBatch,
+		//returns 0 if 'octaves' is not between 1 and FBM_OCTAVES
+		unsigned int fbmGradientSse2(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const uint8_t *table,
+			unsigned int octaves,
+			float frequency
+		);
+		unsigned int fbmGradientAvx2(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const uint8_t *table,
+			unsigned int octaves,
+			float frequency
+		);
+		unsigned int fbmGradientAvx512(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const uint8_t *table,
+			unsigned int octaves,
+			float frequency
+		);
+
+		//Looks up entries of a single permutation
+		template<typename Ops>
+		struct Permutation {
+			const int *p;
+
+			typename Ops::I operator()(typename Ops::I index) const
+			{
+				return Ops::gather(p, index);
+			}
+		};
+
+		//v * M using shifts and adds
+		template<typename Ops, unsigned int M>
+		inline typename Ops::I multiply(typename Ops::I v)
+		{
+			if constexpr(M == 0)
+				return Ops::set(0);
+			else if constexpr(M == 1)
+				return v;
+			else if constexpr(M % 2 == 0)
+				return Ops::shiftLeft(multiply<Ops, M / 2>(v), 1);
+			else
+				return Ops::add(multiply<Ops, M - 1>(v), v);
+		}
+
+		//Looks up entries of one octave's permutation in an interleaved
+		//table, entry i is at p[i * FBM_OCTAVES]
+		template<typename Ops>
+		struct InterleavedPermutation {
+			const uint8_t *p;
+
+			typename Ops::I operator()(typename Ops::I index) const
+			{
+				return Ops::gatherByte(p, multiply<Ops, FBM_OCTAVES>(index));
+			}
+		};
+
+		//Same hash as perlin::gradient, returns the index of the gradient
+		template<typename Ops, typename Table>
+		inline typename Ops::I gradientIndex(
+			typename Ops::I x,
+			typename Ops::I y,
+			const Table &p
+		) {
+			typedef typename Ops::I I;
+			I a = Ops::mul(x, 3284157443u);
+			I b = Ops::bitxor(y, Ops::rotl16(a));
+			b = Ops::mul(b, 1911520717u);
+			a = Ops::bitxor(a, Ops::rotl16(b));
+			a = Ops::mul(a, 2048419325u);
+
+			I index = p(Ops::mask(a, 255));
+			index = p(Ops::mask(Ops::add(index, b), 255));
+			index = p(Ops::mask(index, 255));
+			return Ops::mask(index, 3);
+		}
+
+		//Gradient vector at a grid point and its dot product with the
+		//offset of (x, y) from that grid point
+		template<typename Ops>
+		struct Corner {
+			typename Ops::F gx, gy, value;
+		};
+
+		template<typename Ops, typename Table>
+		inline Corner<Ops> dotGradient(
+			typename Ops::I gridx,
+			typename Ops::I gridy,
+			typename Ops::F x,
+			typename Ops::F y,
+			const Table &p
+		) {
+			typedef typename Ops::F F;
+			typename Ops::I index = gradientIndex<Ops>(gridx, gridy, p);
+			Corner<Ops> corner;
+			corner.gx = Ops::lookup4(index, 1.0f, -1.0f, 0.0f, 0.0f);
+			corner.gy = Ops::lookup4(index, 0.0f, 0.0f, 1.0f, -1.0f);
+			F
+				dx = Ops::sub(x, Ops::toFloat(gridx)),
+				dy = Ops::sub(y, Ops::toFloat(gridy));
+			corner.value = Ops::add(Ops::mul(corner.gx, dx), Ops::mul(corner.gy, dy));
+			return corner;
+		}
+
+		//(3 - 2t) * t * t
+		template<typename Ops>
+		inline typename Ops::F fade(typename Ops::F t)
+		{
+			typename Ops::F s = Ops::sub(Ops::constant(3.0f), Ops::mul(Ops::constant(2.0f), t));
+			return Ops::mul(Ops::mul(s, t), t);
+		}
+
+		//6 * t * (1 - t)
+		template<typename Ops>
+		inline typename Ops::F fadeDerivative(typename Ops::F t)
+		{
+			typename Ops::F s = Ops::mul(Ops::constant(6.0f), t);
+			return Ops::mul(s, Ops::sub(Ops::constant(1.0f), t));
+		}
+
+		//Derivative of interpolate(a, b, t) given the derivatives of a and b
+		//along with the fade value and its derivative with respect to the
+		//same variable (0 if t does not depend on it)
+		template<typename Ops>
+		inline typename Ops::F lerpDerivative(
+			typename Ops::F a,
+			typename Ops::F b,
+			typename Ops::F da,
+			typename Ops::F db,
+			typename Ops::F s,
+			typename Ops::F ds
+		) {
+			typename Ops::F d = Ops::add(da, Ops::mul(Ops::sub(db, da), s));
+			return Ops::add(d, Ops::mul(Ops::sub(b, a), ds));
+		}
+
+		//Noise at (x, y) and its partial derivatives (only if Gradient is
+		//true, otherwise they are 0)
+		template<typename Ops>
+		struct Sample {
+			typename Ops::F value, dx, dy;
+		};
+
+		template<typename Ops, bool Gradient, typename Table>
+		inline Sample<Ops> sample(typename Ops::F x, typename Ops::F y, const Table &p)
+		{
+			typedef typename Ops::F F;
+			typedef typename Ops::I I;
+			I
+				leftx = Ops::floor(x),
+				lowery = Ops::floor(y),
+				rightx = Ops::add(leftx, Ops::set(1)),
+				uppery = Ops::add(lowery, Ops::set(1));
+			Corner<Ops>
+				lowerleft = dotGradient<Ops>(leftx, lowery, x, y, p),
+				lowerright = dotGradient<Ops>(rightx, lowery, x, y, p),
+				upperleft = dotGradient<Ops>(leftx, uppery, x, y, p),
+				upperright = dotGradient<Ops>(rightx, uppery, x, y, p);
+			F
+				tx = Ops::sub(x, Ops::toFloat(leftx)),
+				ty = Ops::sub(y, Ops::toFloat(lowery));
+			F
+				lerpedlower = Ops::interpolate(lowerleft.value, lowerright.value, tx),
+				lerpedupper = Ops::interpolate(upperleft.value, upperright.value, tx);
+
+			Sample<Ops> result;
+			result.value = Ops::interpolate(lerpedlower, lerpedupper, ty);
+			const F zero = Ops::constant(0.0f);
+			if(!Gradient) {
+				result.dx = zero;
+				result.dy = zero;
+				return result;
+			}
+
+			F
+				sx = fade<Ops>(tx),
+				sy = fade<Ops>(ty),
+				dsx = fadeDerivative<Ops>(tx),
+				dsy = fadeDerivative<Ops>(ty);
+			F
+				lowerdx = lerpDerivative<Ops>(
+					lowerleft.value, lowerright.value, lowerleft.gx, lowerright.gx, sx, dsx
+				),
+				lowerdy = lerpDerivative<Ops>(
+					lowerleft.value, lowerright.value, lowerleft.gy, lowerright.gy, sx, zero
+				),
+				upperdx = lerpDerivative<Ops>(
+					upperleft.value, upperright.value, upperleft.gx, upperright.gx, sx, dsx
+				),
+				upperdy = lerpDerivative<Ops>(
+					upperleft.value, upperright.value, upperleft.gy, upperright.gy, sx, zero
+				);
+			result.dx = lerpDerivative<Ops>(lerpedlower, lerpedupper, lowerdx, upperdx, sy, zero);
+			result.dy = lerpDerivative<Ops>(lerpedlower, lerpedupper, lowerdy, upperdy, sy, dsy);
+			return result;
+		}
+
+		template<typename Ops, bool Gradient>
+		inline void noise(
+			const float *px,
+			const float *py,
+			float *out,
+			float *outdx,
+			float *outdy,
+			const int *p
+		) {
+			Sample<Ops> result = sample<Ops, Gradient>(
+				Ops::load(px),
+				Ops::load(py),
+				Permutation<Ops>{ p }
+			);
+			Ops::store(out, result.value);
+			if(!Gradient)
+				return;
+			Ops::store(outdx, result.dx);
+			Ops::store(outdy, result.dy);
+		}
+
+		template<typename Ops>
+		inline unsigned int noiseBatch(
+			const float *x,
+			const float *y,
+			float *out,
+			unsigned int n,
+			const int *p
+		) {
+			unsigned int i = 0;
+			for(; i + Ops::WIDTH <= n; i += Ops::WIDTH)
+				noise<Ops, false>(x + i, y + i, out + i, nullptr, nullptr, p);
+			return i;
+		}
+
+		template<typename Ops>
+		inline unsigned int noiseGradientBatch(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const int *p
+		) {
+			unsigned int i = 0;
+			for(; i + Ops::WIDTH <= n; i += Ops::WIDTH)
+				noise<Ops, true>(x + i, y + i, out + i, dx + i, dy + i, p);
+			return i;
+		}
+
+		//Sums the octaves for one vector of points, octave i is sampled at
+		//(x / freq[i], y / freq[i]) and its value is scaled by amplitude[i]
+		//and its derivatives by gradscale[i]
+		template<typename Ops, unsigned int... Octave>
+		inline void fbmGradient(
+			const float *px,
+			const float *py,
+			float *out,
+			float *outdx,
+			float *outdy,
+			const uint8_t *table,
+			const float *freq,
+			const float *amplitude,
+			const float *gradscale,
+			std::integer_sequence<unsigned int, Octave...>
+		) {
+			typedef typename Ops::F F;
+			//freq[i] = freq[0] / 2^i, scaling by a power of two is exact so
+			//(x / freq[0]) * 2^i rounds to the same value as x / freq[i]
+			//(unless x / freq[0] is subnormal, which no world coordinate is)
+			//and only one division is needed
+			F
+				x = Ops::div(Ops::load(px), Ops::constant(freq[0])),
+				y = Ops::div(Ops::load(py), Ops::constant(freq[0]));
+			F height = Ops::constant(0.0f), dx = height, dy = height;
+			auto octave = [&](unsigned int i) {
+				F octavescale = Ops::constant(float(1u << i));
+				Sample<Ops> octavesample = sample<Ops, true>(
+					Ops::mul(x, octavescale),
+					Ops::mul(y, octavescale),
+					InterleavedPermutation<Ops>{ table + i }
+				);
+				F scale = Ops::constant(gradscale[i]);
+				height = Ops::add(height, Ops::mul(octavesample.value, Ops::constant(amplitude[i])));
+				dx = Ops::add(dx, Ops::mul(octavesample.dx, scale));
+				dy = Ops::add(dy, Ops::mul(octavesample.dy, scale));
+			};
+			//Comma fold, the octaves are summed in order
+			(octave(Octave), ...);
+			Ops::store(out, height);
+			Ops::store(outdx, dx);
+			Ops::store(outdy, dy);
+		}
+
+		template<typename Ops, unsigned int Octaves>
+		unsigned int fbmGradientBatch(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const uint8_t *table,
+			float frequency
+		) {
+			//Computed the same way as the loop in getHeightsAndGradients
+			float freq[Octaves], amplitude[Octaves], gradscale[Octaves];
+			float f = frequency, a = 1.0f;
+			for(unsigned int i = 0; i < Octaves; i++) {
+				freq[i] = f;
+				amplitude[i] = a;
+				gradscale[i] = a / f;
+				f /= 2.0f;
+				a /= 2.0f;
+			}
+
+			unsigned int i = 0;
+			for(; i + Ops::WIDTH <= n; i += Ops::WIDTH) {
+				fbmGradient<Ops>(
+					x + i,
+					y + i,
+					out + i,
+					dx + i,
+					dy + i,
+					table,
+					freq,
+					amplitude,
+					gradscale,
+					std::make_integer_sequence<unsigned int, Octaves>()
+				);
+			}
+			return i;
+		}
+
+		typedef unsigned int (*FbmKernel)(
+			const float*,
+			const float*,
+			float*,
+			float*,
+			float*,
+			unsigned int,
+			const uint8_t*,
+			float
+		);
+
+		//Kernel for 'octaves' octaves (1 to FBM_OCTAVES)
+		template<typename Ops, unsigned int... Octaves>
+		inline FbmKernel fbmKernel(
+			unsigned int octaves,
+			std::integer_sequence<unsigned int, Octaves...>
+		) {
+			static const FbmKernel kernels[] = { fbmGradientBatch<Ops, Octaves + 1>... };
+			return kernels[octaves - 1];
+		}
+
+		template<typename Ops>
+		inline unsigned int fbmGradientDispatch(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const uint8_t *table,
+			unsigned int octaves,
+			float frequency
+		) {
+			if(octaves == 0 || octaves > FBM_OCTAVES)
+				return 0;
+			FbmKernel kernel = fbmKernel<Ops>(
+				octaves,
+				std::make_integer_sequence<unsigned int, FBM_OCTAVES>()
+			);
+			return kernel(x, y, out, dx, dy, n, table, frequency);
+		}
+	}
+}
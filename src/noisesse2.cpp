@@ -0,0 +1,172 @@
+#include "noisekernel.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+namespace {
+	struct Sse2 {
+		static const unsigned int WIDTH = 4;
+		typedef __m128 F;
+		typedef __m128i I;
+
+		static F load(const float *p) { return _mm_loadu_ps(p); }
+		static void store(float *p, F v) { _mm_storeu_ps(p, v); }
+		static F add(F a, F b) { return _mm_add_ps(a, b); }
+		static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+		static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+		static F div(F a, F b) { return _mm_div_ps(a, b); }
+		static F toFloat(I v) { return _mm_cvtepi32_ps(v); }
+		static F constant(float v) { return _mm_set1_ps(v); }
+
+		static I set(int v) { return _mm_set1_epi32(v); }
+		static I add(I a, I b) { return _mm_add_epi32(a, b); }
+		static I bitxor(I a, I b) { return _mm_xor_si128(a, b); }
+		static I mask(I v, int m) { return _mm_and_si128(v, _mm_set1_epi32(m)); }
+		static I rotl16(I v) { return _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16)); }
+		static I shiftLeft(I v, int n) { return _mm_slli_epi32(v, n); }
+
+		//SSE2 has no 32 bit multiply, so multiply the even and odd lanes
+		//separately and interleave the low halves of the products
+		static I mul(I v, unsigned int m)
+		{
+			const __m128i factor = _mm_set1_epi32(m);
+			__m128i even = _mm_mul_epu32(v, factor);
+			__m128i odd = _mm_mul_epu32(_mm_srli_epi64(v, 32), factor);
+			return _mm_unpacklo_epi32(
+				_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+				_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))
+			);
+		}
+
+		//No gather instruction either
+		static I gather(const int *p, I index)
+		{
+			alignas(16) int indices[4];
+			_mm_store_si128((__m128i*)indices, index);
+			return _mm_setr_epi32(p[indices[0]], p[indices[1]], p[indices[2]], p[indices[3]]);
+		}
+
+		//Same as gather but reads the bytes at p[offset]
+		static I gatherByte(const uint8_t *p, I offset)
+		{
+			alignas(16) int offsets[4];
+			_mm_store_si128((__m128i*)offsets, offset);
+			return _mm_setr_epi32(p[offsets[0]], p[offsets[1]], p[offsets[2]], p[offsets[3]]);
+		}
+
+		//Truncate and then subtract one wherever that rounded up
+		static I floor(F v)
+		{
+			__m128i truncated = _mm_cvttps_epi32(v);
+			__m128 roundedup = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), v);
+			return _mm_add_epi32(truncated, _mm_castps_si128(roundedup));
+		}
+
+		static F lookup4(I index, float v0, float v1, float v2, float v3)
+		{
+			F
+				a = _mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(index, set(0))), _mm_set1_ps(v0)),
+				b = _mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(index, set(1))), _mm_set1_ps(v1)),
+				c = _mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(index, set(2))), _mm_set1_ps(v2)),
+				d = _mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(index, set(3))), _mm_set1_ps(v3));
+			return _mm_or_ps(_mm_or_ps(a, b), _mm_or_ps(c, d));
+		}
+
+		static __m128d interpolate(__m128d a, __m128d ba, __m128d t)
+		{
+			__m128d s = _mm_sub_pd(_mm_set1_pd(3.0), _mm_mul_pd(t, _mm_set1_pd(2.0)));
+			return _mm_add_pd(_mm_mul_pd(_mm_mul_pd(_mm_mul_pd(ba, s), t), t), a);
+		}
+
+		//(b - a) * (3.0 - t * 2.0) * t * t + a, evaluated in double
+		//precision like perlin::interpolate
+		static F interpolate(F a, F b, F t)
+		{
+			F ba = _mm_sub_ps(b, a);
+			__m128d
+				lo = interpolate(_mm_cvtps_pd(a), _mm_cvtps_pd(ba), _mm_cvtps_pd(t)),
+				hi = interpolate(
+					_mm_cvtps_pd(_mm_movehl_ps(a, a)),
+					_mm_cvtps_pd(_mm_movehl_ps(ba, ba)),
+					_mm_cvtps_pd(_mm_movehl_ps(t, t))
+				);
+			return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+		}
+	};
+}
+
+namespace perlin {
+	namespace simd {
+		unsigned int noiseSse2(
+			const float *x,
+			const float *y,
+			float *out,
+			unsigned int n,
+			const int *p
+		) {
+			return noiseBatch<Sse2>(x, y, out, n, p);
+		}
+
+		unsigned int noiseGradientSse2(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const int *p
+		) {
+			return noiseGradientBatch<Sse2>(x, y, out, dx, dy, n, p);
+		}
+
+		unsigned int fbmGradientSse2(
+			const float *x,
+			const float *y,
+			float *out,
+			float *dx,
+			float *dy,
+			unsigned int n,
+			const uint8_t *table,
+			unsigned int octaves,
+			float frequency
+		) {
+			return fbmGradientDispatch<Sse2>(x, y, out, dx, dy, n, table, octaves, frequency);
+		}
+	}
+}
+#else
+namespace perlin {
+	namespace simd {
+		unsigned int noiseSse2(const float*, const float*, float*, unsigned int, const int*)
+		{
+			return 0;
+		}
+
+		unsigned int noiseGradientSse2(
+			const float*,
+			const float*,
+			float*,
+			float*,
+			float*,
+			unsigned int,
+			const int*
+		) {
+			return 0;
+		}
+
+		unsigned int fbmGradientSse2(
+			const float*,
+			const float*,
+			float*,
+			float*,
+			float*,
+			unsigned int,
+			const uint8_t*,
+			unsigned int,
+			float
+		) {
+			return 0;
+		}
+	}
+}
+#endif
@@ -0,0 +1,177 @@
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "flightrecorder.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+
+namespace prof {
+	//Number of samples a thread can record before its oldest samples
+	//start getting overwritten
+	constexpr uint32_t RING_SIZE = 8192;
+
+	//Written only by its owning thread, read only by the thread that
+	//calls collect
+	struct RingBuffer {
+		Sample samples[RING_SIZE];
+		std::atomic<uint32_t> head = 0;
+		//Index of the next sample that has not been collected
+		uint32_t tail = 0;
+		uint32_t threadid;
+		std::string name;
+	};
+
+	struct Phase {
+		const char *name;
+		uint64_t total = 0, max = 0;
+		unsigned int calls = 0;
+	};
+
+	//Buffers are never freed so that samples from threads that have
+	//exited can still be collected
+	std::mutex bufferlock;
+	std::vector<std::shared_ptr<RingBuffer>> buffers;
+	std::vector<Phase> phases;
+	unsigned int dropped = 0;
+
+	RingBuffer& threadBuffer()
+	{
+		thread_local std::shared_ptr<RingBuffer> buffer;
+		if(!buffer) {
+			buffer = std::make_shared<RingBuffer>();
+			std::lock_guard<std::mutex> guard(bufferlock);
+			buffer->threadid = buffers.size();
+			buffer->name = "thread " + std::to_string(buffer->threadid);
+			buffers.push_back(buffer);
+		}
+		return *buffer;
+	}
+
+	uint64_t now()
+	{
+		auto t = std::chrono::steady_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+	}
+
+	void record(const Sample &sample)
+	{
+		RingBuffer &buffer = threadBuffer();
+		uint32_t head = buffer.head.load(std::memory_order_relaxed);
+		buffer.samples[head % RING_SIZE] = sample;
+		buffer.head.store(head + 1, std::memory_order_release);
+	}
+
+	void nameThread(const std::string &name)
+	{
+		RingBuffer &buffer = threadBuffer();
+		std::lock_guard<std::mutex> guard(bufferlock);
+		buffer.name = name;
+	}
+
+	std::vector<std::string> threadNames()
+	{
+		std::lock_guard<std::mutex> guard(bufferlock);
+		std::vector<std::string> names;
+		for(const auto &buffer : buffers)
+			names.push_back(buffer->name);
+		return names;
+	}
+
+	ScopedTimer::ScopedTimer(const char *phasename)
+	{
+		sample.name = phasename;
+		sample.haspos = false;
+		sample.start = now();
+	}
+
+	ScopedTimer::ScopedTimer(const char *phasename, int x, int z)
+	{
+		sample.name = phasename;
+		sample.x = x;
+		sample.z = z;
+		sample.haspos = true;
+		sample.start = now();
+	}
+
+	ScopedTimer::~ScopedTimer()
+	{
+		sample.end = now();
+		record(sample);
+	}
+
+	void addSample(const Sample &sample)
+	{
+		uint64_t duration = sample.end - sample.start;
+		for(auto &phase : phases) {
+			//Names are static so comparing pointers is enough
+			if(phase.name != sample.name)
+				continue;
+			phase.total += duration;
+			phase.max = duration > phase.max ? duration : phase.max;
+			phase.calls++;
+			return;
+		}
+
+		Phase phase;
+		phase.name = sample.name;
+		phase.total = phase.max = duration;
+		phase.calls = 1;
+		phases.push_back(phase);
+	}
+
+	void collect()
+	{
+		std::lock_guard<std::mutex> guard(bufferlock);
+		for(auto &buffer : buffers) {
+			uint32_t head = buffer->head.load(std::memory_order_acquire);
+			if(head - buffer->tail > RING_SIZE) {
+				dropped += head - buffer->tail - RING_SIZE;
+				buffer->tail = head - RING_SIZE;
+			}
+
+			for(; buffer->tail != head; buffer->tail++) {
+				Sample sample = buffer->samples[buffer->tail % RING_SIZE];
+				//The owning thread may have lapped us while we were
+				//copying the sample
+				uint32_t current = buffer->head.load(std::memory_order_acquire);
+				if(current - buffer->tail > RING_SIZE) {
+					dropped++;
+					continue;
+				}
+				addSample(sample);
+				if(tracing())
+					traceSample(sample, buffer->threadid);
+				if(flightRecording())
+					flightSample(sample, buffer->threadid);
+			}
+		}
+	}
+
+	void printSummary(const char *header, unsigned int frames)
+	{
+		fprintf(stderr, "%s\n", header);
+		if(frames == 0)
+			return;
+		for(const auto &phase : phases) {
+			fprintf(
+				stderr,
+				"  %-32s mean: %8.3f ms | max: %8.3f ms | calls: %u\n",
+				phase.name,
+				double(phase.total) / 1e6 / double(frames),
+				double(phase.max) / 1e6,
+				phase.calls
+			);
+		}
+		if(dropped > 0)
+			fprintf(stderr, "  (%u samples dropped)\n", dropped);
+	}
+
+	void reset()
+	{
+		phases.clear();
+		dropped = 0;
+	}
+}
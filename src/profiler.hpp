@@ -0,0 +1,74 @@
+/*
+ * Lightweight phase timers for the frame loop and world generation.
+ *
+ * PROFILE_SCOPE("name") times the rest of the enclosing scope and stores
+ * the result in a ring buffer owned by the calling thread so that timing
+ * never takes a lock. Names must be string literals (or otherwise live
+ * for the whole program) since only the pointer is stored.
+ *
+ * The main thread calls prof::collect() once per frame which drains every
+ * thread's ring buffer and adds the samples to per phase totals, if a ring
+ * buffer fills up before it is drained the oldest samples are dropped.
+ *
+ * PROFILE_SCOPE_XZ("name", x, z) does the same but also records a chunk
+ * position, which shows up in traces (see trace.hpp).
+ *
+ * Building with -DNO_PROFILING compiles every timer out.
+ * */
+
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace prof {
+	struct Sample {
+		const char *name;
+		//Nanoseconds since an arbitrary (but fixed) point in time
+		uint64_t start, end;
+		//Chunk position the sample is about, only valid if haspos is set
+		int x, z;
+		bool haspos;
+	};
+
+	//Current time in nanoseconds, same clock as Sample::start and end
+	uint64_t now();
+	//Adds a sample to the calling thread's ring buffer
+	void record(const Sample &sample);
+	//Names the calling thread in traces, threads that are not named are
+	//called "thread <id>"
+	void nameThread(const std::string &name);
+	//Name of every thread that has recorded a sample, indexed by thread id
+	std::vector<std::string> threadNames();
+
+	class ScopedTimer {
+		Sample sample;
+	public:
+		ScopedTimer(const char *phasename);
+		ScopedTimer(const char *phasename, int x, int z);
+		~ScopedTimer();
+		ScopedTimer(const ScopedTimer &) = delete;
+		ScopedTimer& operator=(const ScopedTimer &) = delete;
+	};
+
+	//Drains the ring buffers of every thread, call once per frame
+	void collect();
+	//Prints 'header' followed by the mean time per frame and the longest
+	//single sample of every phase since the last reset, 'frames' is the
+	//number of frames the totals were collected over
+	void printSummary(const char *header, unsigned int frames);
+	//Clears the totals
+	void reset();
+}
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#ifdef NO_PROFILING
+#define PROFILE_SCOPE(name)
+#define PROFILE_SCOPE_XZ(name, x, z)
+#else
+#define PROFILE_SCOPE(name) \
+	prof::ScopedTimer PROFILE_CONCAT(proftimer, __LINE__)(name)
+#define PROFILE_SCOPE_XZ(name, x, z) \
+	prof::ScopedTimer PROFILE_CONCAT(proftimer, __LINE__)(name, x, z)
+#endif
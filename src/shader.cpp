@@ -1,4 +1,5 @@
 #include "shader.hpp"
+#include "memledger.hpp"
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -78,6 +79,7 @@ ShaderProgram::ShaderProgram(unsigned int vertex, unsigned int fragment)
 
 	glDetachShader(programid, vertex);
 	glDetachShader(programid, fragment);
+	loadUniforms();
 }
 
 ShaderProgram::ShaderProgram(const char *vertpath, const char *fragpath)
@@ -110,6 +112,28 @@ ShaderProgram::ShaderProgram(const char *vertpath, const char *fragpath)
 	//Clean up
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
+	loadUniforms();
+}
+
+void ShaderProgram::loadUniforms()
+{
+	unsigned int frameconstants = glGetUniformBlockIndex(programid, "FrameConstants");
+	if(frameconstants != GL_INVALID_INDEX)
+		glUniformBlockBinding(programid, frameconstants, FRAME_CONSTANTS_BINDING);
+
+	int count = 0;
+	glGetProgramiv(programid, GL_ACTIVE_UNIFORMS, &count);
+	for(int i = 0; i < count; i++) {
+		char name[256];
+		int len, size;
+		GLenum type;
+		glGetActiveUniform(programid, i, 255, &len, &size, &type, name);
+		name[len] = '\0';
+		//Uniforms in a block do not have a location
+		int location = glGetUniformLocation(programid, name);
+		if(location >= 0)
+			uniformLocations[name] = location;
+	}
 }
 
 void ShaderProgram::use()
@@ -130,41 +154,82 @@ int ShaderProgram::getUniformLocation(const char *uniformName)
 
 void ShaderProgram::uniformMat4x4(const char *uniformName, const glm::mat4 &mat)
 {
-	int location = getUniformLocation(uniformName);
-	glUniformMatrix4fv(location, 1, false, glm::value_ptr(mat));
+	set(getUniform<glm::mat4>(uniformName), mat);
 }
 
 void ShaderProgram::uniformVec4(const char *uniformName, const glm::vec4 &vec)
 {
-	int location = getUniformLocation(uniformName);
-	glUniform4f(location, vec.x, vec.y, vec.z, vec.w);
+	set(getUniform<glm::vec4>(uniformName), vec);
 }
 
 void ShaderProgram::uniformVec3(const char *uniformName, const glm::vec3 &vec)
 {
-	int location = getUniformLocation(uniformName);
-	glUniform3f(location, vec.x, vec.y, vec.z);
+	set(getUniform<glm::vec3>(uniformName), vec);
 }
 
 void ShaderProgram::uniformVec2(const char *uniformName, const glm::vec2 &vec)
 {
-	int location = getUniformLocation(uniformName);
-	glUniform2f(location, vec.x, vec.y);
+	set(getUniform<glm::vec2>(uniformName), vec);
 }
 
 void ShaderProgram::uniformFloat(const char *uniformName, float value)
 {
-	int location = getUniformLocation(uniformName);
-	glUniform1f(location, value);
+	set(getUniform<float>(uniformName), value);
 }
 
 void ShaderProgram::uniformInt(const char *uniformName, int value)
 {
-	int location = getUniformLocation(uniformName);
-	glUniform1i(location, value);
+	set(getUniform<int>(uniformName), value);
+}
+
+void ShaderProgram::set(Uniform<glm::mat4> uniform, const glm::mat4 &mat)
+{
+	glUniformMatrix4fv(uniform.location, 1, false, glm::value_ptr(mat));
+}
+
+void ShaderProgram::set(Uniform<glm::vec4> uniform, const glm::vec4 &vec)
+{
+	glUniform4f(uniform.location, vec.x, vec.y, vec.z, vec.w);
+}
+
+void ShaderProgram::set(Uniform<glm::vec3> uniform, const glm::vec3 &vec)
+{
+	glUniform3f(uniform.location, vec.x, vec.y, vec.z);
+}
+
+void ShaderProgram::set(Uniform<glm::vec2> uniform, const glm::vec2 &vec)
+{
+	glUniform2f(uniform.location, vec.x, vec.y);
+}
+
+void ShaderProgram::set(Uniform<float> uniform, float value)
+{
+	glUniform1f(uniform.location, value);
+}
+
+void ShaderProgram::set(Uniform<int> uniform, int value)
+{
+	glUniform1i(uniform.location, value);
 }
 
 unsigned int ShaderProgram::getid()
 {
 	return programid;
 }
+
+unsigned int createFrameConstantsBuffer()
+{
+	unsigned int buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, buffer);
+	mem::trackBuffer("frame constants", buffer, sizeof(FrameConstants));
+	return buffer;
+}
+
+void updateFrameConstants(unsigned int buffer, const FrameConstants &constants)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameConstants), &constants);
+}
@@ -7,6 +7,37 @@
 
 typedef unsigned int ShaderId;
 
+//Uniform buffer binding point of the FrameConstants block
+constexpr unsigned int FRAME_CONSTANTS_BINDING = 0;
+
+//Values that are the same for every shader program during a frame, the
+//layout matches the std140 'FrameConstants' uniform block in the shaders
+//so it can be uploaded to the uniform buffer as is
+struct FrameConstants {
+	glm::mat4 persp;
+	glm::mat4 view;
+	glm::vec3 lightdir;
+	float time;
+	glm::vec3 camerapos;
+	float padding;
+};
+static_assert(sizeof(FrameConstants) == 160, "FrameConstants must match the std140 layout");
+
+//Creates the uniform buffer that holds the frame constants and binds it
+//to FRAME_CONSTANTS_BINDING, returns the id of the buffer
+unsigned int createFrameConstantsBuffer();
+//Uploads the frame constants to the uniform buffer, every program that
+//declares the FrameConstants block sees the new values
+void updateFrameConstants(unsigned int buffer, const FrameConstants &constants);
+
+//Location of a uniform of type T, look it up once with
+//ShaderProgram::getUniform outside of the render loop so that setting
+//it every frame does not need to look up the uniform by name
+template<typename T>
+struct Uniform {
+	int location = -1;
+};
+
 //Helper function that reads contents of a shader file, 
 //returns the string containing the content,
 //takes path of shader as argument
@@ -22,6 +53,9 @@ unsigned int createShader(const char *path, GLenum shaderType);
 class ShaderProgram {
 	std::map<std::string, int> uniformLocations;
 	unsigned int programid;
+	//Called after linking, binds the uniform blocks to their binding points
+	//and stores the location of every active uniform
+	void loadUniforms();
 public:
 	//creates a shader program by taking in two shader ids,
 	//one that is a vertex shader and the other that is
@@ -34,6 +68,19 @@ public:
 	int getUniformLocation(const char *uniformName);
 	unsigned int getid();
 
+	template<typename T>
+	Uniform<T> getUniform(const char *uniformName)
+	{
+		return Uniform<T>{ getUniformLocation(uniformName) };
+	}
+	//The program needs to be in use when setting uniforms
+	void set(Uniform<glm::mat4> uniform, const glm::mat4 &mat);
+	void set(Uniform<glm::vec4> uniform, const glm::vec4 &vec);
+	void set(Uniform<glm::vec3> uniform, const glm::vec3 &vec);
+	void set(Uniform<glm::vec2> uniform, const glm::vec2 &vec);
+	void set(Uniform<float> uniform, float value);
+	void set(Uniform<int> uniform, int value);
+
 	void uniformMat4x4(const char *uniformName, const glm::mat4 &mat);
 	void uniformVec4(const char *uniformName, const glm::vec4 &vec);
 	void uniformVec3(const char *uniformName, const glm::vec3 &vec);
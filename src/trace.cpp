@@ -0,0 +1,121 @@
+#include "trace.hpp"
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+namespace prof {
+	//Only touched by the thread that calls collect()
+	std::vector<TraceEvent> events;
+	size_t eventlimit = 0;
+	size_t droppedevents = 0;
+	uint64_t tracestart = 0;
+	std::atomic<bool> tracingon = false;
+	std::string traceoutput = "trace.json";
+
+	void startTrace(size_t maxevents)
+	{
+		events.clear();
+		//Reserving up front means recording never reallocates
+		events.reserve(maxevents);
+		eventlimit = maxevents;
+		droppedevents = 0;
+		tracestart = now();
+		tracingon = true;
+		fprintf(stderr, "Started trace\n");
+	}
+
+	void writeEvent(FILE *file, const TraceEvent &event, uint64_t start)
+	{
+		const Sample &sample = event.sample;
+		fprintf(
+			file,
+			"{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+			"\"ts\":%.3f,\"dur\":%.3f",
+			sample.name,
+			event.threadid,
+			double(sample.start - start) / 1000.0,
+			double(sample.end - sample.start) / 1000.0
+		);
+		if(sample.haspos)
+			fprintf(file, ",\"args\":{\"x\":%d,\"z\":%d}", sample.x, sample.z);
+		fprintf(file, "}");
+	}
+
+	bool writeTrace(const char *path, const std::vector<TraceEvent> &events, uint64_t start)
+	{
+		FILE *file = fopen(path, "w");
+		if(!file) {
+			fprintf(stderr, "Failed to write trace to %s\n", path);
+			return false;
+		}
+
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		//Thread names go first as metadata events
+		std::vector<std::string> names = threadNames();
+		for(uint32_t i = 0; i < names.size(); i++) {
+			fprintf(
+				file,
+				"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+				"\"args\":{\"name\":\"%s\"}}",
+				i > 0 ? ",\n" : "",
+				i,
+				names.at(i).c_str()
+			);
+		}
+		for(size_t i = 0; i < events.size(); i++) {
+			if(i > 0 || !names.empty())
+				fprintf(file, ",\n");
+			writeEvent(file, events.at(i), start);
+		}
+		fprintf(file, "\n]}\n");
+		fclose(file);
+		return true;
+	}
+
+	bool stopTrace(const char *path)
+	{
+		tracingon = false;
+		if(!writeTrace(path, events, tracestart))
+			return false;
+
+		fprintf(stderr, "Wrote %zu trace events to %s", events.size(), path);
+		if(droppedevents > 0)
+			fprintf(stderr, " (%zu dropped)", droppedevents);
+		fprintf(stderr, "\n");
+		events.clear();
+		events.shrink_to_fit();
+		return true;
+	}
+
+	bool tracing()
+	{
+		return tracingon;
+	}
+
+	void setTraceOutput(const char *path)
+	{
+		traceoutput = path;
+	}
+
+	void toggleTrace()
+	{
+		if(tracing())
+			stopTrace(traceoutput.c_str());
+		else
+			startTrace();
+	}
+
+	void traceSample(const Sample &sample, uint32_t threadid)
+	{
+		//Samples that started before the trace did would have a
+		//negative timestamp
+		if(sample.start < tracestart)
+			return;
+		if(events.size() >= eventlimit) {
+			droppedevents++;
+			return;
+		}
+		events.push_back({ sample, threadid });
+	}
+}
@@ -0,0 +1,43 @@
+/*
+ * Records the samples from the phase timers (see profiler.hpp) on a single
+ * timeline and writes them out in the Chrome trace event JSON format which
+ * can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Every sample becomes a complete event on its thread's track, samples
+ * with a chunk position carry it as arguments. Events are added when
+ * prof::collect() drains the ring buffers so only samples collected while
+ * tracing is on are recorded. At most 'maxevents' events are kept, once
+ * that is reached the rest are dropped and counted.
+ * */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "profiler.hpp"
+
+namespace prof {
+	struct TraceEvent {
+		Sample sample;
+		uint32_t threadid;
+	};
+
+	//Default number of events kept in memory (48 bytes each)
+	constexpr size_t TRACE_MAX_EVENTS = 1 << 18;
+
+	//Clears any previously recorded events and starts recording
+	void startTrace(size_t maxevents = TRACE_MAX_EVENTS);
+	//Stops recording and writes the trace to 'path', returns false if
+	//the file could not be written
+	bool stopTrace(const char *path);
+	bool tracing();
+	//Where toggleTrace writes the trace to
+	void setTraceOutput(const char *path);
+	//Starts tracing if it is off, otherwise stops it and writes the trace
+	void toggleTrace();
+	//Called by collect() for every sample while tracing
+	void traceSample(const Sample &sample, uint32_t threadid);
+	//Writes 'events' as a trace with timestamps relative to 'start',
+	//returns false if the file could not be written
+	bool writeTrace(const char *path, const std::vector<TraceEvent> &events, uint64_t start);
+}
@@ -0,0 +1,110 @@
+#include "worldscheduler.hpp"
+#include "profiler.hpp"
+#include "memledger.hpp"
+#include <chrono>
+
+namespace infworld {
+	WorldScheduler::WorldScheduler(
+		ChunkTable *chunktables,
+		unsigned int count,
+		DecorationTable *decorationtable,
+		float budgetms,
+		unsigned int maxchunksbuilding
+	) {
+		tables = chunktables;
+		tablecount = count;
+		decorations = decorationtable;
+		budget = budgetms;
+		maxbuilding = maxchunksbuilding;
+	}
+
+	void WorldScheduler::onDecorationsGenerated(const std::function<void()> &task)
+	{
+		decorationtasks.push_back(task);
+	}
+
+	bool WorldScheduler::uploadChunk()
+	{
+		for(unsigned int i = 0; i < tablecount; i++) {
+			//Outdated chunks are thrown away without being uploaded so
+			//keep going until a chunk is actually uploaded
+			while(tables[i].readyCount() > 0)
+				if(tables[i].uploadChunks(1) > 0)
+					return true;
+		}
+		return false;
+	}
+
+	unsigned int WorldScheduler::update(
+		const glm::vec3 &camerapos,
+		const glm::vec3 &predicted,
+		const geo::Frustum &viewfrustum,
+		const worldseed &permutations
+	) {
+		PROFILE_SCOPE("WorldScheduler::update");
+		auto starttime = std::chrono::steady_clock::now();
+
+		//Queueing up work is cheap (the actual work happens on the worker
+		//pool) so this is always done
+		for(unsigned int i = 0; i < tablecount; i++) {
+			tables[i].generateNewChunks(camerapos.x, camerapos.z);
+			tables[i].prefetchChunks(predicted.x, predicted.z);
+		}
+		submitChunks(tables, tablecount, camerapos, viewfrustum, maxbuilding, permutations);
+		size_t staging = 0;
+		for(unsigned int i = 0; i < tablecount; i++)
+			staging += tables[i].stagingBytes();
+		mem::set("chunk staging", staging);
+
+		//Prefetching only writes to the staging area so it is safe while
+		//the decoration tasks are still queued up
+		bool decorationsidle = !decorationsgenerating && decorationtaskspending == 0;
+		if(decorationsidle && decorations->genNewDecorations(camerapos.x, camerapos.z, permutations))
+			decorationsgenerating = true;
+		decorations->prefetch(predicted.x, predicted.z, permutations);
+		if(decorationsgenerating && decorations->finishedGenerating()) {
+			decorationsgenerating = false;
+			mem::set("decorations", decorations->bytes());
+			for(const auto &task : decorationtasks) {
+				tasks.push_back([this, task]() {
+					task();
+					decorationtaskspending--;
+				});
+				decorationtaskspending++;
+			}
+		}
+
+		//Alternate between uploading chunks and running tasks until
+		//the budget runs out, at least one of each is done every frame
+		//so that the world keeps updating even if the budget is tiny
+		unsigned int uploaded = 0;
+		while(true) {
+			bool worked = uploadChunk();
+			if(worked)
+				uploaded++;
+			if(!tasks.empty()) {
+				tasks.front()();
+				tasks.pop_front();
+				worked = true;
+			}
+
+			if(!worked)
+				break;
+
+			std::chrono::duration<float, std::milli> elapsed = 
+				std::chrono::steady_clock::now() - starttime;
+			if(elapsed.count() >= budget)
+				break;
+		}
+
+		return uploaded;
+	}
+
+	unsigned int WorldScheduler::backlog() const
+	{
+		unsigned int count = tasks.size();
+		for(unsigned int i = 0; i < tablecount; i++)
+			count += tables[i].pendingCount();
+		return count;
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * Owns all of the work needed to keep the world up to date as the camera
+ * moves (uploading chunks, regenerating decorations and rebuilding their
+ * instance buffers) and spreads it out over multiple frames so that a
+ * single frame only spends a limited amount of time on it.
+ * */
+
+#pragma once
+#include <deque>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include "infworld.hpp"
+
+namespace infworld {
+	class WorldScheduler {
+		ChunkTable *tables;
+		unsigned int tablecount;
+		DecorationTable *decorations;
+		//Milliseconds that can be spent each frame
+		float budget;
+		//Maximum number of chunks being built at once (see submitChunks)
+		unsigned int maxbuilding;
+		//Work that is carried over to the next frame if it does not fit
+		//in the budget
+		std::deque<std::function<void()>> tasks;
+		//Tasks to queue up once new decorations have been generated
+		std::vector<std::function<void()>> decorationtasks;
+		bool decorationsgenerating = false;
+		//Decoration tasks in 'tasks' that have not been run yet, they read
+		//the decorations so new ones can not be generated until they are done
+		unsigned int decorationtaskspending = 0;
+
+		//Uploads a single chunk (more detailed levels of detail first),
+		//returns false if there were no chunks to upload
+		bool uploadChunk();
+	public:
+		WorldScheduler(
+			ChunkTable *chunktables,
+			unsigned int count,
+			DecorationTable *decorationtable,
+			float budgetms,
+			unsigned int maxchunksbuilding
+		);
+		//Adds a task that is run every time new decorations have been
+		//generated (such as generating the offsets for the decorations)
+		void onDecorationsGenerated(const std::function<void()> &task);
+		//Queues up new chunks and decorations for the camera's position
+		//(prefetching the ones around 'predicted') and then runs as much
+		//of the queued work as fits in the budget, returns the number of
+		//chunks that were uploaded
+		unsigned int update(
+			const glm::vec3 &camerapos,
+			const glm::vec3 &predicted,
+			const geo::Frustum &viewfrustum,
+			const worldseed &permutations
+		);
+		//Amount of work that has not been done yet: chunks that are not
+		//uploaded and tasks that have not been run
+		unsigned int backlog() const;
+	};
+}